@@ -0,0 +1,190 @@
+#include "Aes128.h"
+
+#include "keys.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AES128_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using aes128_detail::SBOX;
+using aes128_detail::xtime;
+
+// Te[0][x] is the MixColumns column of S(x) in the top byte, (2s, s, s, 3s);
+// Te[1..3] are the same word rotated for the other three rows, so a round
+// is sixteen lookups and XORs.
+struct TTables {
+    uint32_t te[4][256];
+};
+
+constexpr TTables make_ttables()
+{
+    TTables t{};
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = SBOX.v[i], s2 = xtime(s), s3 = static_cast<uint8_t>(s2 ^ s);
+        uint32_t w = (uint32_t(s2) << 24) | (uint32_t(s) << 16) | (uint32_t(s) << 8) | s3;
+        for (int r = 0; r < 4; r++)
+            t.te[r][i] = r ? (w >> (8 * r)) | (w << (32 - 8 * r)) : w;
+    }
+    return t;
+}
+
+constexpr TTables tables = make_ttables();
+
+constexpr uint32_t load_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+constexpr void store_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+constexpr uint32_t final_word(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    return (uint32_t(SBOX.v[a >> 24]) << 24) | (uint32_t(SBOX.v[(b >> 16) & 0xff]) << 16)
+        | (uint32_t(SBOX.v[(c >> 8) & 0xff]) << 8) | SBOX.v[d & 0xff];
+}
+
+constexpr void encrypt_block(const aes128_key& key, const uint8_t* in, uint8_t* out)
+{
+    const uint32_t* rk = key.w;
+    const uint32_t (*te)[256] = tables.te;
+    uint32_t s0 = load_be32(in) ^ rk[0];
+    uint32_t s1 = load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = load_be32(in + 12) ^ rk[3];
+    for (int round = 1; round < 10; round++) {
+        rk += 4;
+        uint32_t t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ rk[0];
+        uint32_t t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ rk[1];
+        uint32_t t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ rk[2];
+        uint32_t t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    rk += 4;
+    store_be32(out, final_word(s0, s1, s2, s3) ^ rk[0]);
+    store_be32(out + 4, final_word(s1, s2, s3, s0) ^ rk[1]);
+    store_be32(out + 8, final_word(s2, s3, s0, s1) ^ rk[2]);
+    store_be32(out + 12, final_word(s3, s0, s1, s2) ^ rk[3]);
+}
+
+// Known answers, checked by the compiler. FIPS-197 A.1 and C.1 pin down the
+// key schedule and the cipher; the ctrKey0B blocks are what the tiny-AES
+// code this replaced gave, so existing 0xB files decrypt the same.
+struct Block {
+    uint8_t b[16];
+};
+
+constexpr Block encrypt_const(const uint8_t* key, Block in)
+{
+    Block out{};
+    encrypt_block(aes128_expand_key(key), in.b, out.b);
+    return out;
+}
+
+constexpr bool same(const Block& a, const Block& b)
+{
+    for (int i = 0; i < 16; i++)
+        if (a.b[i] != b.b[i])
+            return false;
+    return true;
+}
+
+constexpr uint8_t fips_a1_key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static_assert(aes128_expand_key(fips_a1_key).w[4] == 0xa0fafe17u, "AES key schedule");
+static_assert(aes128_expand_key(fips_a1_key).w[43] == 0xb6630ca6u, "AES key schedule");
+
+constexpr uint8_t fips_c1_key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+constexpr Block counting = { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff } };
+static_assert(same(encrypt_const(fips_c1_key, counting), { { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a } }), "AES-128 FIPS-197 C.1");
+
+static_assert(same(encrypt_const(ctrKey0B, Block{}), { { 0xbf, 0xcc, 0x24, 0x45, 0x9b, 0x15, 0xd8, 0x0b,
+    0x97, 0xb1, 0x3f, 0xb2, 0x2b, 0x38, 0x8a, 0x2c } }), "AES-128 ctrKey0B, zero block");
+static_assert(same(encrypt_const(ctrKey0B, counting), { { 0x8a, 0xd0, 0xda, 0xfa, 0x78, 0x98, 0xc1, 0x99,
+    0xb9, 0x08, 0x56, 0xc5, 0x67, 0x53, 0x4b, 0x1b } }), "AES-128 ctrKey0B, counting block");
+static_assert(same(encrypt_const(ctrKey0B, { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } }), { { 0xc6, 0x9a, 0x2d, 0x4b, 0x25, 0xc3, 0xe9, 0x18,
+    0x12, 0xe8, 0xdb, 0x3a, 0x75, 0x10, 0xf2, 0xf1 } }), "AES-128 ctrKey0B, all-ones block");
+
+void encrypt_ttable(const aes128_key& key, const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    for (size_t i = 0; i < blocks; i++)
+        encrypt_block(key, in + 16 * i, out + 16 * i);
+}
+
+#ifdef AES128_X86
+// Four blocks at a time, so the AESENC latency of one overlaps the others.
+__attribute__((target("aes,sse2")))
+void encrypt_aesni(const aes128_key& key, const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    __m128i rk[11];
+    for (int i = 0; i < 11; i++)
+        rk[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key.bytes + 16 * i));
+    const __m128i* src = reinterpret_cast<const __m128i*>(in);
+    __m128i* dst = reinterpret_cast<__m128i*>(out);
+    size_t i = 0;
+    for (; i + 4 <= blocks; i += 4) {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + i), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + i + 1), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + i + 2), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + i + 3), rk[0]);
+        for (int r = 1; r < 10; r++) {
+            b0 = _mm_aesenc_si128(b0, rk[r]);
+            b1 = _mm_aesenc_si128(b1, rk[r]);
+            b2 = _mm_aesenc_si128(b2, rk[r]);
+            b3 = _mm_aesenc_si128(b3, rk[r]);
+        }
+        _mm_storeu_si128(dst + i, _mm_aesenclast_si128(b0, rk[10]));
+        _mm_storeu_si128(dst + i + 1, _mm_aesenclast_si128(b1, rk[10]));
+        _mm_storeu_si128(dst + i + 2, _mm_aesenclast_si128(b2, rk[10]));
+        _mm_storeu_si128(dst + i + 3, _mm_aesenclast_si128(b3, rk[10]));
+    }
+    for (; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(src + i), rk[0]);
+        for (int r = 1; r < 10; r++)
+            b = _mm_aesenc_si128(b, rk[r]);
+        _mm_storeu_si128(dst + i, _mm_aesenclast_si128(b, rk[10]));
+    }
+}
+#endif
+
+typedef void(*encrypt_fn)(const aes128_key&, const uint8_t*, uint8_t*, size_t);
+
+encrypt_fn select_encrypt(bool hardware)
+{
+#ifdef AES128_X86
+    __builtin_cpu_init();
+    if (hardware && __builtin_cpu_supports("aes"))
+        return encrypt_aesni;
+#endif
+    return encrypt_ttable;
+}
+
+encrypt_fn encrypt_impl = select_encrypt(true);
+
+}
+
+void aes128_encrypt_blocks(const aes128_key& key, const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    encrypt_impl(key, in, out, blocks);
+}
+
+bool aes128_use_hardware(bool enable)
+{
+    encrypt_impl = select_encrypt(enable);
+    return encrypt_impl != encrypt_ttable;
+}
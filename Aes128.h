@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// AES-128 encryption, which is all the mogg format needs: a portable 32-bit
+// T-table implementation, and AES-NI on x86 CPUs that have it. Unlike the
+// tiny-AES code it replaced it keeps no global state, so any number of
+// threads can encrypt at once, and the key schedule is expanded once
+// (at compile time, for a constant key) rather than for every block.
+//
+// The T-table lookups are indexed by key-dependent bytes, so their timing
+// can leak the key through the cache. The only key used here is the
+// published ctrKey0B, so that costs nothing; don't use it for keys that
+// must stay secret.
+
+// A counter block of the mogg's CTR mode, viewed as whichever integer width
+// is handy.
+typedef union {
+	uint64_t qwords[2];
+	uint32_t dwords[4];
+	uint16_t words[8];
+	uint8_t bytes[16];
+} aes_ctr_128;
+
+// An expanded key: the 11 round keys as big-endian words, and the same
+// bytes in memory order for AES-NI.
+struct aes128_key {
+	uint32_t w[44];
+	uint8_t bytes[176];
+};
+
+namespace aes128_detail {
+
+constexpr uint8_t xtime(uint8_t x)
+{
+	return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+struct SBox {
+	uint8_t v[256];
+};
+
+// The S-box from its definition: the multiplicative inverse in GF(2^8),
+// found through log and antilog tables for the generator 3 so that it is
+// cheap enough to evaluate at compile time, then the affine transform.
+constexpr SBox make_sbox()
+{
+	uint8_t exp[256]{}, log[256]{};
+	uint8_t x = 1;
+	for (int i = 0; i < 255; i++) {
+		exp[i] = x;
+		log[x] = static_cast<uint8_t>(i);
+		x = static_cast<uint8_t>(x ^ xtime(x));
+	}
+	SBox s{};
+	for (int i = 0; i < 256; i++) {
+		uint8_t inv = i ? exp[(255 - log[i]) % 255] : 0;
+		uint8_t r = inv;
+		for (int k = 1; k < 5; k++)
+			r ^= static_cast<uint8_t>((inv << k) | (inv >> (8 - k)));
+		s.v[i] = static_cast<uint8_t>(r ^ 0x63);
+	}
+	return s;
+}
+
+inline constexpr SBox SBOX = make_sbox();
+
+constexpr uint32_t sub_word(uint32_t w)
+{
+	return (uint32_t(SBOX.v[w >> 24]) << 24) | (uint32_t(SBOX.v[(w >> 16) & 0xff]) << 16)
+		| (uint32_t(SBOX.v[(w >> 8) & 0xff]) << 8) | SBOX.v[w & 0xff];
+}
+
+}
+
+constexpr aes128_key aes128_expand_key(const uint8_t* key)
+{
+	aes128_key k{};
+	for (int i = 0; i < 4; i++)
+		k.w[i] = (uint32_t(key[4 * i]) << 24) | (uint32_t(key[4 * i + 1]) << 16)
+			| (uint32_t(key[4 * i + 2]) << 8) | key[4 * i + 3];
+	uint8_t rcon = 1;
+	for (int i = 4; i < 44; i++) {
+		uint32_t t = k.w[i - 1];
+		if (i % 4 == 0) {
+			t = aes128_detail::sub_word((t << 8) | (t >> 24)) ^ (uint32_t(rcon) << 24);
+			rcon = aes128_detail::xtime(rcon);
+		}
+		k.w[i] = k.w[i - 4] ^ t;
+	}
+	for (int i = 0; i < 176; i++)
+		k.bytes[i] = static_cast<uint8_t>(k.w[i / 4] >> (24 - 8 * (i % 4)));
+	return k;
+}
+
+// Encrypts `blocks` 16-byte blocks from in to out, which may be the same.
+void aes128_encrypt_blocks(const aes128_key& key, const uint8_t* in, uint8_t* out, size_t blocks);
+
+// Turns the AES-NI path off, so aes128_encrypt_blocks uses the T-tables,
+// or back on if the CPU has it. For tests, which check both; not to be
+// called while other threads encrypt. Returns whether AES-NI is now used.
+bool aes128_use_hardware(bool enable);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Mogg and Ogg headers are little-endian on disk. These helpers read and
+// write them on any host; on little-endian hosts they compile to plain
+// (unaligned) loads and stores.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MOGG_BIG_ENDIAN 1
+#endif
+
+inline uint32_t bswap32(uint32_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap32(v);
+#else
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+#endif
+}
+
+inline uint32_t load_le32(const void* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+#ifdef MOGG_BIG_ENDIAN
+    v = bswap32(v);
+#endif
+    return v;
+}
+
+inline void store_le32(void* p, uint32_t v)
+{
+#ifdef MOGG_BIG_ENDIAN
+    v = bswap32(v);
+#endif
+    memcpy(p, &v, 4);
+}
+
+inline uint64_t load_le64(const void* p)
+{
+    const uint8_t* b = static_cast<const uint8_t*>(p);
+    return load_le32(b) | (static_cast<uint64_t>(load_le32(b + 4)) << 32);
+}
+
+// Converts `count` 32-bit words between host and little-endian order in
+// place. A no-op on little-endian hosts.
+inline void le32_swap_words(void* words, size_t count)
+{
+#ifdef MOGG_BIG_ENDIAN
+    uint8_t* w = static_cast<uint8_t*>(words);
+    for (size_t i = 0; i < count; i++, w += 4) {
+        uint32_t v;
+        memcpy(&v, w, 4);
+        v = bswap32(v);
+        memcpy(w, &v, 4);
+    }
+#else
+    (void)words;
+    (void)count;
+#endif
+}
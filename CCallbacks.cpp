@@ -1,17 +1,32 @@
 #include "CCallbacks.h"
 #include <fstream>
 
+int mogg_fseek64(FILE* file, int64_t offset, int whence) {
+#if defined(_WIN32)
+	return _fseeki64(file, offset, whence);
+#else
+	return fseeko(file, static_cast<off_t>(offset), whence);
+#endif
+}
+int64_t mogg_ftell64(FILE* file) {
+#if defined(_WIN32)
+	return _ftelli64(file);
+#else
+	return ftello(file);
+#endif
+}
+
 size_t mogg_read(void *ptr, size_t size, size_t nmemb, void *datasource) {
 	return fread(ptr, size, nmemb, (FILE*)datasource);
 }
 int mogg_seek(void *datasource, ogg_int64_t offset, int whence) {
-	return fseek((FILE*)datasource, offset, whence);
+	return mogg_fseek64((FILE*)datasource, offset, whence);
 }
 int mogg_close(void *datasource) {
 	return fclose((FILE*)datasource);
 }
 long mogg_tell(void *datasource) {
-	return ftell((FILE*)datasource);
+	return static_cast<long>(mogg_ftell64((FILE*)datasource));
 }
 
 ov_callbacks cCallbacks = {
@@ -36,6 +51,7 @@ ov_callbacks cppCallbacks = {
 			case SEEK_SET: way = file->beg; break;
 			case SEEK_CUR: way = file->cur; break;
 			case SEEK_END: way = file->end; break;
+			default: return -1;
 		}
 		file->seekg(offset, way);
 		return file->fail();
@@ -49,4 +65,36 @@ ov_callbacks cppCallbacks = {
 		auto *file = static_cast<std::ifstream*>(datasource);
 		return file->tellg();
 	}
+};
+
+mogg_write_callbacks cWriteCallbacks = {
+	[](const void *ptr, size_t size, size_t nmemb, void *sink) -> size_t {
+		return fwrite(ptr, size, nmemb, (FILE*)sink);
+	},
+	mogg_seek,
+	mogg_tell
+};
+
+mogg_write_callbacks cppWriteCallbacks = {
+	[](const void *ptr, size_t size, size_t nmemb, void *sink) -> size_t {
+		auto *file = static_cast<std::ofstream*>(sink);
+		file->write((const char*)ptr, size * nmemb);
+		return file->good() ? nmemb : 0;
+	},
+	[](void *sink, ogg_int64_t offset, int whence) -> int {
+		auto *file = static_cast<std::ofstream*>(sink);
+		std::ios_base::seekdir way;
+		switch (whence) {
+			case SEEK_SET: way = file->beg; break;
+			case SEEK_CUR: way = file->cur; break;
+			case SEEK_END: way = file->end; break;
+			default: return -1;
+		}
+		file->seekp(offset, way);
+		return file->fail();
+	},
+	[](void *sink) -> long {
+		auto *file = static_cast<std::ofstream*>(sink);
+		return file->tellp();
+	}
 };
\ No newline at end of file
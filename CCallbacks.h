@@ -3,8 +3,22 @@
 #ifndef _OV_FILE_H_
 #include "XiphTypes.h"
 #endif
+#include "WriteCallbacks.h"
+
+#include <cstdint>
+#include <cstdio>
+
+// fseek and ftell with 64-bit offsets, which plain fseek and ftell lack
+// where long is 32 bits (Windows).
+int mogg_fseek64(FILE* file, int64_t offset, int whence);
+int64_t mogg_ftell64(FILE* file);
 
 // Callbacks using standard C FILE* as a datasource.
 extern ov_callbacks cCallbacks;
 // Callbacks using a C++ ifstream* as a datasource.
-extern ov_callbacks cppCallbacks;
\ No newline at end of file
+extern ov_callbacks cppCallbacks;
+
+// Write callbacks using standard C FILE* as a sink.
+extern mogg_write_callbacks cWriteCallbacks;
+// Write callbacks using a C++ ofstream* as a sink.
+extern mogg_write_callbacks cppWriteCallbacks;
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "DirectFile.h"
+
+#if defined(MOGG_HAVE_DIRECT_FILE)
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <unistd.h>
+
+static bool pwrite_full(int fd, const uint8_t* src, size_t len, uint64_t offset) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, src, len, static_cast<off_t>(offset));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		src += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+// Switches to buffered writes for the rest of the file.
+static void direct_off(DirectFile* f) {
+	if (!f->direct)
+		return;
+	f->direct = false;
+#if defined(O_DIRECT)
+	int flags = fcntl(f->fd, F_GETFL);
+	if (flags != -1)
+		fcntl(f->fd, F_SETFL, flags & ~O_DIRECT);
+#endif
+}
+
+DirectFile* direct_file_open(const char* path) {
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_CLOEXEC)
+	flags |= O_CLOEXEC;
+#endif
+	bool direct = false;
+	int fd = -1;
+#if defined(O_DIRECT)
+	fd = open(path, flags | O_DIRECT, 0666);
+	direct = fd >= 0;
+#endif
+	if (fd < 0)
+		fd = open(path, flags, 0666);
+	if (fd < 0)
+		return nullptr;
+#if defined(F_NOCACHE)
+	direct = fcntl(fd, F_NOCACHE, 1) != -1;
+#endif
+	auto* f = static_cast<DirectFile*>(calloc(1, sizeof(DirectFile)));
+	if (!f) {
+		close(fd);
+		return nullptr;
+	}
+	f->fd = fd;
+	f->direct = direct;
+	return f;
+}
+
+static size_t direct_write(const void *ptr, size_t size, size_t nmemb, void *sink) {
+	auto* f = static_cast<DirectFile*>(sink);
+	auto* src = static_cast<const uint8_t*>(ptr);
+	size_t len = size * nmemb;
+	const size_t block = DirectFile::BLOCK;
+	if (f->direct && (f->offset % block != 0 || reinterpret_cast<uintptr_t>(src) % block != 0
+		|| f->padded_size > f->size)) {
+		// Misaligned, or after the padded tail: no longer possible directly.
+		direct_off(f);
+	}
+	bool ok;
+	if (f->direct) {
+		size_t whole = len / block * block;
+		ok = pwrite_full(f->fd, src, whole, f->offset);
+		if (ok && whole < len) {
+			// Pad the last block out with zeros, to be trimmed at close.
+			void* tail = ::operator new(block, std::align_val_t(block));
+			memset(tail, 0, block);
+			memcpy(tail, src + whole, len - whole);
+			ok = pwrite_full(f->fd, static_cast<uint8_t*>(tail), block, f->offset + whole);
+			::operator delete(tail, std::align_val_t(block));
+			if (ok)
+				f->padded_size = f->offset + whole + block;
+		}
+		if (!ok && errno == EINVAL) {
+			// The filesystem refused direct I/O after all.
+			direct_off(f);
+			ok = pwrite_full(f->fd, src, len, f->offset);
+		}
+	} else {
+		ok = pwrite_full(f->fd, src, len, f->offset);
+	}
+	if (!ok)
+		return 0;
+	f->offset += len;
+	if (f->offset > f->size)
+		f->size = f->offset;
+	return nmemb;
+}
+
+static int direct_seek(void *sink, ogg_int64_t offset, int whence) {
+	auto* f = static_cast<DirectFile*>(sink);
+	int64_t base = whence == SEEK_CUR ? static_cast<int64_t>(f->offset)
+		: whence == SEEK_END ? static_cast<int64_t>(f->size) : 0;
+	if (base + offset < 0)
+		return -1;
+	f->offset = static_cast<uint64_t>(base + offset);
+	return 0;
+}
+
+static long direct_tell(void *sink) {
+	return static_cast<long>(static_cast<DirectFile*>(sink)->offset);
+}
+
+int direct_file_close(DirectFile* f) {
+	int ret = 0;
+	if (f->padded_size > f->size && ftruncate(f->fd, static_cast<off_t>(f->size)) != 0)
+		ret = -1;
+	if (close(f->fd) != 0)
+		ret = -1;
+	free(f);
+	return ret;
+}
+
+mogg_write_callbacks directWriteCallbacks = {
+	direct_write,
+	direct_seek,
+	direct_tell
+};
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "WriteCallbacks.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(_WIN32)
+#define MOGG_HAVE_DIRECT_FILE 1
+
+// An output file written around the page cache: O_DIRECT on Linux,
+// F_NOCACHE on macOS. Writes must start at aligned offsets from aligned
+// memory in whole blocks, as MoggWriter's chunks do. The last, partial
+// block is padded with zeros and the padding truncated off at close. Any
+// write that can't be done directly (or a filesystem without O_DIRECT,
+// like tmpfs) quietly falls back to ordinary buffered writes.
+struct DirectFile {
+	static constexpr size_t BLOCK = 4096;
+
+	int fd;
+	bool direct;
+	// Logical end of the data, which may be short of what is on disk
+	// while the padding of the last block is still there.
+	uint64_t offset;
+	uint64_t size;
+	uint64_t padded_size;
+};
+
+// Creates or truncates `path`. Returns NULL on failure.
+DirectFile* direct_file_open(const char* path);
+// Trims the padding, closes and frees. Returns 0 on success.
+int direct_file_close(DirectFile* f);
+
+// Write callbacks using a DirectFile* as a sink.
+extern mogg_write_callbacks directWriteCallbacks;
+#endif
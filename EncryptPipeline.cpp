@@ -0,0 +1,130 @@
+#include "EncryptPipeline.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct Slot {
+    enum State { FREE, READ, ENCRYPTED } state = FREE;
+    uint8_t* data = nullptr;
+    // Output bytes in this slot, and where in the output they start.
+    size_t length = 0;
+    uint64_t out_pos = 0;
+    // Set on the slot after which there is no more data.
+    bool last = false;
+};
+
+// The ring shared by the three stages. Block n always goes through slot
+// n % RING_SIZE, so each stage just walks the slots in order.
+struct Ring {
+    Slot slots[EncryptPipeline::RING_SIZE];
+    std::mutex lock;
+    std::condition_variable changed;
+    bool stop = false;
+
+    // Waits until `slot` is in `state`. Returns false if the pipeline is
+    // stopping instead.
+    bool WaitFor(Slot& slot, Slot::State state) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return stop || slot.state == state; });
+        return !stop;
+    }
+    void Set(Slot& slot, Slot::State state) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            slot.state = state;
+        }
+        changed.notify_all();
+    }
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        changed.notify_all();
+    }
+};
+
+}
+
+bool EncryptPipeline::Run(VorbisEncrypter& encrypter, MoggWriter& out,
+                          const std::function<bool(uint64_t)>& on_chunk) {
+    const std::vector<uint8_t>& header = encrypter.GetHeader();
+    const uint64_t total = encrypter.GetLength();
+    const size_t chunk = out.ChunkSize();
+    Ring ring;
+    for (Slot& slot : ring.slots)
+        slot.data = MoggWriter::AllocateChunk(chunk);
+
+    std::thread reader([&] {
+        uint64_t out_pos = 0;
+        for (uint64_t n = 0;; n++) {
+            Slot& slot = ring.slots[n % RING_SIZE];
+            if (!ring.WaitFor(slot, Slot::FREE))
+                return;
+            size_t want = total - out_pos < chunk ? static_cast<size_t>(total - out_pos) : chunk;
+            size_t got = 0;
+            if (out_pos < header.size()) {
+                got = header.size() - out_pos < want ? static_cast<size_t>(header.size() - out_pos) : want;
+                memcpy(slot.data, header.data() + out_pos, got);
+            }
+            if (got < want) {
+                uint64_t payload_pos = out_pos + got - header.size();
+                got += encrypter.ReadPayload(slot.data + got, want - got, payload_pos);
+            }
+            slot.out_pos = out_pos;
+            slot.length = got;
+            // A short read means the source ended early, as with ReadRaw.
+            slot.last = got < chunk || out_pos + got == total;
+            out_pos += got;
+            ring.Set(slot, Slot::READ);
+            if (slot.last)
+                return;
+        }
+    });
+
+    std::thread encryptor([&] {
+        for (uint64_t n = 0;; n++) {
+            Slot& slot = ring.slots[n % RING_SIZE];
+            if (!ring.WaitFor(slot, Slot::READ))
+                return;
+            uint64_t end = slot.out_pos + slot.length;
+            if (end > header.size()) {
+                size_t skip = slot.out_pos < header.size() ? static_cast<size_t>(header.size() - slot.out_pos) : 0;
+                encrypter.EncryptAt(slot.data + skip, slot.length - skip, slot.out_pos + skip - header.size());
+            }
+            bool last = slot.last;
+            ring.Set(slot, Slot::ENCRYPTED);
+            if (last)
+                return;
+        }
+    });
+
+    bool ok = true;
+    for (uint64_t n = 0;; n++) {
+        Slot& slot = ring.slots[n % RING_SIZE];
+        if (!ring.WaitFor(slot, Slot::ENCRYPTED))
+            break;
+        bool last = slot.last;
+        if (slot.length > 0 && !out.WriteThrough(slot.data, slot.length)) {
+            ok = false;
+            break;
+        }
+        ring.Set(slot, Slot::FREE);
+        if (on_chunk && !on_chunk(out.BytesWritten())) {
+            ok = false;
+            break;
+        }
+        if (last)
+            break;
+    }
+    ring.Stop();
+    reader.join();
+    encryptor.join();
+    for (Slot& slot : ring.slots)
+        MoggWriter::FreeChunk(slot.data, chunk);
+    return ok;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "MoggWriter.h"
+#include "VorbisEncrypter.h"
+
+#include <cstdint>
+#include <functional>
+
+// Writes the mogg of a VorbisEncrypter with reading, encryption and writing
+// overlapped. A reader thread fills a small ring of chunk-sized buffers from
+// the source, an encrypt thread encrypts them in place, and the calling
+// thread hands them to the MoggWriter. Each stage waits when the next one
+// falls behind, so memory stays bounded by the ring, and throughput tends
+// to the slowest stage rather than the sum of all three.
+//
+// The source is read on the reader thread; the writer and `on_chunk` are
+// only called on the calling thread.
+class EncryptPipeline
+{
+public:
+	static constexpr int RING_SIZE = 4;
+
+	// Buffers are out.ChunkSize() bytes and line up with its chunks, so the
+	// writer still sees only full aligned chunks. on_chunk, if set, is called
+	// after each write with the bytes written so far; returning false stops
+	// the pipeline. Returns false if stopped early or the output failed.
+	static bool Run(VorbisEncrypter& encrypter, MoggWriter& out,
+		const std::function<bool(uint64_t)>& on_chunk = nullptr);
+};
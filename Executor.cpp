@@ -0,0 +1,94 @@
+#include "Executor.h"
+
+Executor& Executor::Shared() {
+    static Executor executor(std::thread::hardware_concurrency());
+    return executor;
+}
+
+Executor::Executor(unsigned count)
+    : head(&stub), tail(&stub) {
+    if (count == 0)
+        count = 1;
+    for (unsigned i = 0; i < count; i++)
+        threads.emplace_back([this] { Work(); });
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+void Executor::Push(ExecutorTask* task) {
+    task->next.store(nullptr, std::memory_order_relaxed);
+    ExecutorTask* prev = head.exchange(task, std::memory_order_acq_rel);
+    // Until this store the task is queued but unreachable; Pop sees that
+    // as empty for the moment
+    prev->next.store(task, std::memory_order_release);
+}
+
+ExecutorTask* Executor::Pop() {
+    ExecutorTask* first = tail;
+    ExecutorTask* next = first->next.load(std::memory_order_acquire);
+    if (first == &stub) {
+        if (!next)
+            return nullptr;
+        tail = first = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail = next;
+        return first;
+    }
+    if (first != head.load(std::memory_order_acquire))
+        return nullptr;
+    // `first` is the last task: put the stub behind it so it can be taken
+    Push(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next) {
+        tail = next;
+        return first;
+    }
+    return nullptr;
+}
+
+void Executor::Submit(ExecutorTask* task) {
+    Push(task);
+    pending.fetch_add(1, std::memory_order_seq_cst);
+    // A worker going to sleep counts itself before checking `pending`, so
+    // either it sees this task or this sees it and wakes it
+    if (sleeping.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard<std::mutex> guard(lock); }
+        wake.notify_one();
+    }
+}
+
+void Executor::Work() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        if (stopping)
+            return;
+        if (pending.load(std::memory_order_seq_cst) == 0) {
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            wake.wait(guard, [&] { return stopping || pending.load(std::memory_order_seq_cst) > 0; });
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+            continue;
+        }
+        ExecutorTask* task = Pop();
+        if (!task) {
+            // A submitter is between its exchange and its link
+            guard.unlock();
+            std::this_thread::yield();
+            guard.lock();
+            continue;
+        }
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        guard.unlock();
+        task->Run();
+        guard.lock();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Something for the Executor to run. Tasks are linked into its queue
+// through `next`, so queueing one allocates nothing.
+struct ExecutorTask {
+	virtual ~ExecutorTask() = default;
+	virtual void Run() = 0;
+	std::atomic<ExecutorTask*> next{ nullptr };
+};
+
+// Runs tasks on a fixed set of threads, one per core. Submit is lock-free
+// and O(1), whatever the backlog: the queue is an intrusive multi-producer
+// list (Vyukov's) that producers join with a single exchange. Only the
+// workers take a lock, among themselves, to take tasks off the other end,
+// and a submitter touches the workers' mutex only to wake one that has
+// run out of work.
+class Executor
+{
+public:
+	// The library's executor, started on first use.
+	static Executor& Shared();
+
+	explicit Executor(unsigned threads);
+	// Finishes the tasks already running, abandons the rest.
+	~Executor();
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	// Queues a task, which must stay alive until it has run.
+	void Submit(ExecutorTask* task);
+
+private:
+	struct Stub : ExecutorTask {
+		void Run() override {}
+	};
+
+	void Push(ExecutorTask* task);
+	// Called with `lock` held. May return null while a push is half done.
+	ExecutorTask* Pop();
+	void Work();
+
+	// Producers swap themselves in at `head`; workers take from `tail`.
+	std::atomic<ExecutorTask*> head;
+	ExecutorTask* tail;
+	Stub stub;
+	std::atomic<size_t> pending{ 0 };
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::atomic<unsigned> sleeping{ 0 };
+	bool stopping = false;
+	std::vector<std::thread> threads;
+};
@@ -0,0 +1,166 @@
+#include "FdDatasource.h"
+
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reads up to len bytes at offset, retrying interrupted and short reads.
+// Stops early only at end of file or on an error.
+static size_t pread_full(int fd, uint8_t* dst, size_t len, uint64_t offset) {
+	size_t done = 0;
+	while (done < len) {
+		ssize_t n = pread(fd, dst + done, len - done, static_cast<off_t>(offset + done));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (n == 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+FdDatasource* fd_datasource_from_fd(int fd, bool owns_fd, size_t buffer_size) {
+	if (fd < 0)
+		return nullptr;
+	if (buffer_size == 0)
+		buffer_size = FdDatasource::DEFAULT_BUFFER_SIZE;
+	auto* s = static_cast<FdDatasource*>(calloc(1, sizeof(FdDatasource)));
+	if (!s)
+		return nullptr;
+	s->buffer = static_cast<uint8_t*>(malloc(buffer_size));
+	if (!s->buffer) {
+		free(s);
+		return nullptr;
+	}
+	s->fd = fd;
+	s->owns_fd = owns_fd;
+	s->buffer_capacity = buffer_size;
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(F_RDAHEAD)
+	fcntl(fd, F_RDAHEAD, 1);
+#endif
+	return s;
+}
+
+FdDatasource* fd_datasource_open(const char* path, size_t buffer_size) {
+	int flags = O_RDONLY;
+#if defined(O_CLOEXEC)
+	flags |= O_CLOEXEC;
+#endif
+	int fd;
+	do {
+		fd = open(path, flags);
+	} while (fd < 0 && errno == EINTR);
+	if (fd < 0)
+		return nullptr;
+	FdDatasource* s = fd_datasource_from_fd(fd, true, buffer_size);
+	if (!s)
+		close(fd);
+	return s;
+}
+
+// Also asks for the window after the new one to be read ahead while this
+// one is consumed.
+void fd_datasource_fill(FdDatasource* s) {
+	s->buffer_start = s->pos;
+	s->buffer_length = pread_full(s->fd, s->buffer, s->buffer_capacity, s->pos);
+#if defined(POSIX_FADV_WILLNEED)
+	if (s->buffer_length == s->buffer_capacity)
+		posix_fadvise(s->fd, static_cast<off_t>(s->pos + s->buffer_length),
+			static_cast<off_t>(s->buffer_capacity), POSIX_FADV_WILLNEED);
+#endif
+}
+
+void fd_datasource_drop_cache(FdDatasource* s) {
+#if defined(POSIX_FADV_DONTNEED)
+	posix_fadvise(s->fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+	(void)s;
+#endif
+}
+
+size_t fd_datasource_read(FdDatasource* s, void* ptr, size_t want) {
+	uint8_t* dst = static_cast<uint8_t*>(ptr);
+	size_t got = 0;
+	while (got < want) {
+		if (s->pos >= s->buffer_start && s->pos < s->buffer_start + s->buffer_length) {
+			size_t at = static_cast<size_t>(s->pos - s->buffer_start);
+			size_t n = s->buffer_length - at;
+			if (n > want - got)
+				n = want - got;
+			memcpy(dst + got, s->buffer + at, n);
+			got += n;
+			s->pos += n;
+			continue;
+		}
+		// Big reads skip the buffer rather than copy through it.
+		if (want - got >= s->buffer_capacity) {
+			size_t n = pread_full(s->fd, dst + got, want - got, s->pos);
+			got += n;
+			s->pos += n;
+			break;
+		}
+		fd_datasource_fill(s);
+		if (s->buffer_length == 0)
+			break;
+	}
+	return got;
+}
+
+static size_t fd_read(void *ptr, size_t size, size_t nmemb, void *datasource) {
+	if (size == 0)
+		return 0;
+	return fd_datasource_read(static_cast<FdDatasource*>(datasource), ptr, size * nmemb) / size;
+}
+
+static int fd_seek(void *datasource, ogg_int64_t offset, int whence) {
+	auto* s = static_cast<FdDatasource*>(datasource);
+	int64_t base;
+	switch (whence) {
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = static_cast<int64_t>(s->pos); break;
+		case SEEK_END: {
+			// The only case that needs the kernel, since the file may grow.
+			struct stat st;
+			if (fstat(s->fd, &st) != 0)
+				return -1;
+			base = st.st_size;
+			break;
+		}
+		default: return -1;
+	}
+	if (base + offset < 0)
+		return -1;
+	s->pos = static_cast<uint64_t>(base + offset);
+	return 0;
+}
+
+static int fd_close(void *datasource) {
+	auto* s = static_cast<FdDatasource*>(datasource);
+	int ret = 0;
+	if (s->owns_fd)
+		ret = close(s->fd);
+	free(s->buffer);
+	free(s);
+	return ret == 0 ? 0 : EOF;
+}
+
+static long fd_tell(void *datasource) {
+	return static_cast<long>(static_cast<FdDatasource*>(datasource)->pos);
+}
+
+ov_callbacks fdCallbacks = {
+	fd_read,
+	fd_seek,
+	fd_close,
+	fd_tell
+};
+#endif
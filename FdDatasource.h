@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef _OV_FILE_H_
+#include "XiphTypes.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(_WIN32)
+#define MOGG_HAVE_FD_DATASOURCE 1
+
+// A POSIX file read with pread through a large user-space buffer. The
+// offset is tracked here rather than in the kernel, so seeks and tells are
+// plain arithmetic and re-reading a recent window (as resync does) costs
+// nothing. Works where mmap doesn't, e.g. FUSE mounts or growing files.
+struct FdDatasource {
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+	int fd;
+	bool owns_fd;
+	uint64_t pos;
+	// buffer holds buffer_length bytes of the file from buffer_start.
+	uint8_t* buffer;
+	size_t buffer_capacity;
+	uint64_t buffer_start;
+	size_t buffer_length;
+};
+
+// Opens `path` for reading and hints the kernel for sequential access.
+// Returns NULL on failure. fdCallbacks.close_func closes and frees it.
+FdDatasource* fd_datasource_open(const char* path, size_t buffer_size = FdDatasource::DEFAULT_BUFFER_SIZE);
+// Wraps an already open descriptor, reading from its start. The descriptor
+// is closed along with the datasource only if owns_fd is set.
+FdDatasource* fd_datasource_from_fd(int fd, bool owns_fd, size_t buffer_size = FdDatasource::DEFAULT_BUFFER_SIZE);
+
+// Reads up to len bytes from the current offset. Returns the bytes read.
+size_t fd_datasource_read(FdDatasource* s, void* dst, size_t len);
+// Refills the buffer from the current offset.
+void fd_datasource_fill(FdDatasource* s);
+// Tells the kernel the file's cached pages won't be needed again, once it
+// has been read through.
+void fd_datasource_drop_cache(FdDatasource* s);
+
+// Callbacks using an FdDatasource* as a datasource.
+extern ov_callbacks fdCallbacks;
+#endif
@@ -0,0 +1,268 @@
+#include "Hash.h"
+#include "ByteOrder.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint64_t P1 = 0x9E3779B185EBCA87ull;
+const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t P3 = 0x165667B19E3779F9ull;
+const uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * P2;
+    return rotl64(acc, 31) * P1;
+}
+
+inline uint64_t xxh_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= xxh_round(0, v);
+    return acc * P1 + P4;
+}
+
+// Consumes whole 32-byte stripes, returning how many bytes were used.
+size_t xxh_stripes(uint64_t* v, const uint8_t* p, size_t length)
+{
+    const uint8_t* start = p;
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    for (; length >= 32; p += 32, length -= 32) {
+        v0 = xxh_round(v0, load_le64(p));
+        v1 = xxh_round(v1, load_le64(p + 8));
+        v2 = xxh_round(v2, load_le64(p + 16));
+        v3 = xxh_round(v3, load_le64(p + 24));
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+    return p - start;
+}
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr32(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+inline uint32_t load_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+void sha256_blocks_generic(uint32_t* state, const uint8_t* p, size_t blocks)
+{
+    for (; blocks > 0; blocks--, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = load_be32(p + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HASH_X86
+// The SHA extensions keep the state as two registers, ABEF and CDGH, and do
+// four rounds per SHA256RNDS2 pair; SHA256MSG1/MSG2 extend the schedule four
+// words at a time.
+__attribute__((target("sha,sse4.1")))
+void sha256_blocks_shani(uint32_t* state, const uint8_t* p, size_t blocks)
+{
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);          // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);    // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+    for (; blocks > 0; blocks--, p += 64) {
+        __m128i save0 = state0, save1 = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; i++)
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i)), byteswap);
+        // Unrolled, so the message registers and conditions resolve statically
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            __m128i& m = msg[i & 3];
+            __m128i k = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(K + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, k);
+            if (i >= 3 && i < 15) {
+                // Finish w[4(i+1)..] from the message words so far
+                __m128i& next = msg[(i + 1) & 3];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(m, msg[(i + 3) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, m);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(k, 0x0E));
+            if (i >= 1 && i < 13)
+                msg[(i + 3) & 3] = _mm_sha256msg1_epu32(msg[(i + 3) & 3], m);
+        }
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);    // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+#endif
+
+typedef void(*sha256_fn)(uint32_t*, const uint8_t*, size_t);
+
+sha256_fn select_sha256()
+{
+#ifdef HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+        return sha256_blocks_shani;
+#endif
+    return sha256_blocks_generic;
+}
+
+const sha256_fn sha256_blocks = select_sha256();
+
+}
+
+Xxh64::Xxh64()
+    : v{ P1 + P2, P2, 0, 0 - P1 } {}
+
+void Xxh64::Update(const void* data, size_t length) {
+    auto* p = static_cast<const uint8_t*>(data);
+    total += length;
+    if (pending_length) {
+        size_t n = 32 - pending_length < length ? 32 - pending_length : length;
+        std::memcpy(pending + pending_length, p, n);
+        pending_length += n;
+        p += n;
+        length -= n;
+        if (pending_length < 32)
+            return;
+        xxh_stripes(v, pending, 32);
+        pending_length = 0;
+    }
+    size_t used = xxh_stripes(v, p, length);
+    std::memcpy(pending, p + used, length - used);
+    pending_length = length - used;
+}
+
+uint64_t Xxh64::Digest() const {
+    uint64_t h;
+    if (total >= 32) {
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = xxh_merge(h, v[i]);
+    } else {
+        h = P5;
+    }
+    h += total;
+    const uint8_t* p = pending;
+    size_t length = pending_length;
+    for (; length >= 8; p += 8, length -= 8)
+        h = rotl64(h ^ xxh_round(0, load_le64(p)), 27) * P1 + P4;
+    if (length >= 4) {
+        h = rotl64(h ^ (load_le32(p) * P1), 23) * P2 + P3;
+        p += 4;
+        length -= 4;
+    }
+    for (; length > 0; p++, length--)
+        h = rotl64(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+Sha256::Sha256()
+    : state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } {}
+
+void Sha256::Update(const void* data, size_t length) {
+    auto* p = static_cast<const uint8_t*>(data);
+    total += length;
+    if (pending_length) {
+        size_t n = 64 - pending_length < length ? 64 - pending_length : length;
+        std::memcpy(pending + pending_length, p, n);
+        pending_length += n;
+        p += n;
+        length -= n;
+        if (pending_length < 64)
+            return;
+        sha256_blocks(state, pending, 1);
+        pending_length = 0;
+    }
+    sha256_blocks(state, p, length / 64);
+    p += length / 64 * 64;
+    pending_length = length % 64;
+    std::memcpy(pending, p, pending_length);
+}
+
+void Sha256::Digest(uint8_t* out) const {
+    // Padding: a 1 bit, zeros, then the bit length, on a copy of the state
+    uint32_t h[8];
+    std::memcpy(h, state, sizeof(h));
+    uint8_t last[128] = {};
+    std::memcpy(last, pending, pending_length);
+    last[pending_length] = 0x80;
+    size_t blocks = pending_length < 56 ? 1 : 2;
+    uint64_t bits = total * 8;
+    for (int i = 0; i < 8; i++)
+        last[blocks * 64 - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    sha256_blocks(h, last, blocks);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = static_cast<uint8_t>(h[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(h[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(h[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(h[i]);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming hashes for checksumming output as it is written: feed bytes in
+// any number of Update calls, then read the digest.
+
+// XXH64 with seed 0, a fast non-cryptographic hash. The digest is the same
+// as the reference xxHash implementation's.
+class Xxh64
+{
+public:
+	Xxh64();
+	void Update(const void* data, size_t length);
+	// The hash of everything so far; more can still be added after.
+	uint64_t Digest() const;
+
+private:
+	uint64_t v[4];
+	uint64_t total{ 0 };
+	uint8_t pending[32];
+	size_t pending_length{ 0 };
+};
+
+// SHA-256 (FIPS 180-4). Uses the SHA extensions on x86 CPUs that have them.
+class Sha256
+{
+public:
+	static constexpr size_t DIGEST_SIZE = 32;
+
+	Sha256();
+	void Update(const void* data, size_t length);
+	// Writes the 32-byte digest of everything so far; more can still be
+	// added after.
+	void Digest(uint8_t* out) const;
+
+private:
+	uint32_t state[8];
+	uint64_t total{ 0 };
+	uint8_t pending[64];
+	size_t pending_length{ 0 };
+};
@@ -0,0 +1,134 @@
+#include "MoggWriter.h"
+
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Enough for a writer and a full EncryptPipeline ring.
+const size_t CACHED_CHUNKS = 5;
+
+struct ChunkCache {
+    bool enabled = false;
+    std::vector<std::pair<uint8_t*, size_t>> free;
+    void Clear() {
+        for (auto& chunk : free)
+            ::operator delete(chunk.first, std::align_val_t(MoggWriter::ALIGNMENT));
+        free.clear();
+    }
+    ~ChunkCache() {
+        Clear();
+    }
+};
+
+thread_local ChunkCache chunkCache;
+
+}
+
+uint8_t* MoggWriter::AllocateChunk(size_t size) {
+    auto& free = chunkCache.free;
+    for (size_t i = free.size(); i-- > 0;) {
+        if (free[i].second == size) {
+            uint8_t* buffer = free[i].first;
+            free.erase(free.begin() + i);
+            return buffer;
+        }
+    }
+    return static_cast<uint8_t*>(::operator new(size, std::align_val_t(ALIGNMENT)));
+}
+
+void MoggWriter::FreeChunk(uint8_t* buffer, size_t size) {
+    if (!chunkCache.enabled) {
+        ::operator delete(buffer, std::align_val_t(ALIGNMENT));
+        return;
+    }
+    auto& free = chunkCache.free;
+    if (free.size() == CACHED_CHUNKS) {
+        ::operator delete(free.front().first, std::align_val_t(ALIGNMENT));
+        free.erase(free.begin());
+    }
+    free.emplace_back(buffer, size);
+}
+
+void MoggWriter::CacheChunks(bool enable) {
+    chunkCache.enabled = enable;
+    if (!enable)
+        chunkCache.Clear();
+}
+
+MoggWriter::MoggWriter(void* sink, mogg_write_callbacks callbacks, size_t chunk_size)
+    : sink(sink), cb(callbacks) {
+    if (chunk_size == 0)
+        chunk_size = DEFAULT_CHUNK_SIZE;
+    capacity = (chunk_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    buffer = AllocateChunk(capacity);
+}
+
+MoggWriter::~MoggWriter() {
+    FreeChunk(buffer, capacity);
+}
+
+void MoggWriter::HashWith(Xxh64* xxh64, Sha256* sha256) {
+    this->xxh64 = xxh64;
+    this->sha256 = sha256;
+}
+
+void MoggWriter::Hash(const uint8_t* data, size_t length) {
+    if (xxh64)
+        xxh64->Update(data, length);
+    if (sha256)
+        sha256->Update(data, length);
+}
+
+bool MoggWriter::Send(const uint8_t* data, size_t length) {
+    while (length > 0 && !failed) {
+        size_t n = cb.write_func(data, 1, length, sink);
+        if (n == 0) {
+            failed = true;
+            break;
+        }
+        data += n;
+        length -= n;
+        written += n;
+    }
+    return !failed;
+}
+
+bool MoggWriter::Write(const void* data, size_t length) {
+    auto* src = static_cast<const uint8_t*>(data);
+    while (length > 0 && !failed) {
+        size_t n = capacity - used < length ? capacity - used : length;
+        std::memcpy(buffer + used, src, n);
+        if (!Commit(n))
+            break;
+        src += n;
+        length -= n;
+    }
+    return !failed;
+}
+
+uint8_t* MoggWriter::Reserve(size_t* available) {
+    *available = capacity - used;
+    return buffer + used;
+}
+
+bool MoggWriter::Commit(size_t length) {
+    Hash(buffer + used, length);
+    used += length;
+    if (used < capacity)
+        return !failed;
+    return Flush();
+}
+
+bool MoggWriter::Flush() {
+    size_t n = used;
+    used = 0;
+    return Send(buffer, n);
+}
+
+bool MoggWriter::WriteThrough(const void* data, size_t length) {
+    Hash(static_cast<const uint8_t*>(data), length);
+    return Flush() && Send(static_cast<const uint8_t*>(data), length);
+}
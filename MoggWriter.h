@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Hash.h"
+#include "WriteCallbacks.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Buffers mogg output and hands it to a mogg_write_callbacks sink in large
+// chunks. The buffer is page-aligned and every chunk but the last is full,
+// so the sink sees writes at aligned offsets of a fixed size.
+class MoggWriter
+{
+public:
+	static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+	static constexpr size_t ALIGNMENT = 4096;
+
+	// chunk_size is rounded up to a multiple of ALIGNMENT.
+	MoggWriter(void* sink, mogg_write_callbacks callbacks, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+	~MoggWriter();
+	MoggWriter(const MoggWriter&) = delete;
+	MoggWriter& operator=(const MoggWriter&) = delete;
+
+	// Copies data into the buffer, sending out each chunk as it fills.
+	// Returns false once the sink has failed.
+	bool Write(const void* data, size_t length);
+	// Space for producers to fill in place instead of calling Write: up to
+	// `available` bytes at the returned pointer, then Commit what was used.
+	uint8_t* Reserve(size_t* available);
+	bool Commit(size_t length);
+	// Sends whatever is buffered, even a partial chunk.
+	bool Flush();
+	// Flushes, then sends `data` as is, without copying it into the buffer.
+	// For producers that already fill chunk-sized, aligned buffers.
+	bool WriteThrough(const void* data, size_t length);
+
+	// Feeds every byte written from now on, in order, to these hashes
+	// (either may be null). Bytes are hashed as they are committed, while
+	// still in cache, rather than when the chunk is sent.
+	void HashWith(Xxh64* xxh64, Sha256* sha256);
+
+	size_t ChunkSize() const { return capacity; }
+
+	uint64_t BytesWritten() const { return written + used; }
+
+	// Aligned chunk buffers, for the writer and producers that WriteThrough.
+	static uint8_t* AllocateChunk(size_t size);
+	static void FreeChunk(uint8_t* buffer, size_t size);
+	// Buffers this size are mapped fresh by the allocator each time. A
+	// thread that converts file after file, such as a daemon worker, can
+	// turn this on to keep the last few it frees (up to 5 MiB) for its next
+	// conversion rather than faulting in new pages. They go when it is
+	// turned off or the thread exits. Off by default.
+	static void CacheChunks(bool enable);
+	bool Failed() const { return failed; }
+
+private:
+	bool Send(const uint8_t* data, size_t length);
+	void Hash(const uint8_t* data, size_t length);
+
+	void* sink;
+	mogg_write_callbacks cb;
+	uint8_t* buffer;
+	size_t capacity;
+	size_t used{ 0 };
+	uint64_t written{ 0 };
+	bool failed{ false };
+	Xxh64* xxh64{ nullptr };
+	Sha256* sha256{ nullptr };
+};
@@ -0,0 +1,166 @@
+#include "OggClip.h"
+#include "ByteOrder.h"
+#include "oggcrc.h"
+
+#include <cstring>
+
+namespace {
+
+struct Packet {
+	std::vector<uint8_t> data;
+	int64_t end_sample;
+};
+
+// Packs whole packets into pages of about TARGET_BODY bytes. Every page
+// ends on a packet boundary, so each one has a granule position.
+class PageWriter {
+public:
+	static constexpr size_t TARGET_BODY = 4096;
+
+	PageWriter(std::vector<uint8_t>& out, int32_t serial, int32_t seq)
+		: out(out), serial(serial), seq(seq) {}
+
+	// Adds a packet finishing at `granule`, first closing the page if the
+	// packet would overflow its lacing, or it is full and already holds
+	// min_packets packets.
+	void Add(const std::vector<uint8_t>& packet, int64_t granule, size_t min_packets = 1) {
+		size_t segments = packet.size() / 255 + 1;
+		if (lacing.size() + segments > 255 || (packets >= min_packets && body.size() >= TARGET_BODY))
+			Flush(false);
+		for (size_t left = packet.size(); ; left -= 255) {
+			lacing.push_back(static_cast<uint8_t>(left < 255 ? left : 255));
+			if (left < 255)
+				break;
+		}
+		body.insert(body.end(), packet.begin(), packet.end());
+		this->granule = granule;
+		packets++;
+	}
+
+	void Flush(bool eos) {
+		if (packets == 0)
+			return;
+		size_t at = out.size();
+		out.resize(at + PAGE_HEADER_SIZE + lacing.size() + body.size());
+		uint8_t* page = out.data() + at;
+		std::memcpy(page, "OggS", 4);
+		page[4] = 0;
+		page[5] = eos ? 0x04 : 0;
+		store_le32(page + 6, static_cast<uint32_t>(granule));
+		store_le32(page + 10, static_cast<uint32_t>(static_cast<uint64_t>(granule) >> 32));
+		store_le32(page + 14, static_cast<uint32_t>(serial));
+		store_le32(page + 18, static_cast<uint32_t>(seq++));
+		store_le32(page + 22, 0);
+		page[26] = static_cast<uint8_t>(lacing.size());
+		std::memcpy(page + PAGE_HEADER_SIZE, lacing.data(), lacing.size());
+		std::memcpy(page + PAGE_HEADER_SIZE + lacing.size(), body.data(), body.size());
+		store_le32(page + 22, ogg_page_crc(page, out.size() - at));
+		lacing.clear();
+		body.clear();
+		packets = 0;
+	}
+
+private:
+	std::vector<uint8_t>& out;
+	int32_t serial;
+	int32_t seq;
+	std::vector<uint8_t> lacing;
+	std::vector<uint8_t> body;
+	int64_t granule = 0;
+	size_t packets = 0;
+};
+
+}
+
+std::variant<std::string, std::vector<uint8_t>> ExtractOggClip(void* datasource, ov_callbacks callbacks,
+	uint64_t start, uint64_t end, const vorbis_options& options) {
+	if (end <= start)
+		return std::string("Empty clip range");
+	vorbis_state* vs;
+	err e = vorbis_init(datasource, &vs, callbacks, &options);
+	if (e != OK)
+		return std::string(str_of_err(e));
+	// Audio always starts on a new page, so the header pages copy as is
+	if (vs->next_segment != vs->cur_page.page_segments) {
+		vorbis_free(vs);
+		return std::string("Setup header doesn't end its page");
+	}
+	size_t header_start = vs->data_offset;
+	size_t header_end = vs->cur_page_start + vs->cur_page.header_size + vs->cur_page.body_size;
+	int32_t serial = vs->serial;
+	int32_t seq = vs->cur_page.seq_no + 1;
+
+	// The last packet ending at or before start primes the decoder; the
+	// rest are those producing any sample up to end
+	Packet primer{ {}, -1 };
+	std::vector<Packet> packets;
+	while ((e = vorbis_next(vs)) == OK) {
+		if (vs->chains != 0) {
+			vorbis_free(vs);
+			return std::string("Clip reaches past the first stream of a chained file");
+		}
+		Packet packet{ std::vector<uint8_t>(vs->cur_packet.buf, vs->cur_packet.buf + vs->cur_packet.size),
+			vs->next_sample };
+		// The stream's own end trim, if this is its last packet
+		if ((vs->cur_page.header_type_flag & 0x04) && vs->next_segment == vs->cur_page.page_segments
+			&& vs->cur_page.granule_pos >= 0
+			&& vs->chain_sample_base + vs->cur_page.granule_pos < packet.end_sample)
+			packet.end_sample = vs->chain_sample_base + vs->cur_page.granule_pos;
+		if (packets.empty() && static_cast<uint64_t>(packet.end_sample) <= start) {
+			primer = std::move(packet);
+			continue;
+		}
+		if (packets.empty() && primer.end_sample >= 0)
+			packets.push_back(std::move(primer));
+		packets.push_back(std::move(packet));
+		if (static_cast<uint64_t>(packets.back().end_sample) >= end)
+			break;
+	}
+	vorbis_free(vs);
+	if (e != OK && e != READ_ERROR)
+		return std::string(str_of_err(e));
+	if (packets.empty())
+		return std::string("Clip starts after the end of the stream");
+	// A decoder only trims the start of a first page that isn't also the
+	// last, and trims the end of one that is. So unless the clip starts
+	// right where the primer ends, it must reach past the first page's one
+	// real packet, wherever it ends.
+	if (packets.size() < 3 && start > static_cast<uint64_t>(packets.front().end_sample))
+		return std::string("Clip too short to cut without decoding");
+
+	std::vector<uint8_t> clip(header_end - header_start);
+	if (callbacks.seek_func(datasource, static_cast<ogg_int64_t>(header_start), SEEK_SET) != 0
+		|| callbacks.read_func(clip.data(), 1, clip.size(), datasource) != clip.size())
+		return std::string(str_of_err(READ_ERROR));
+	// Leave out the pages of any other logical stream multiplexed in
+	size_t kept = 0;
+	for (size_t at = 0; at < clip.size();) {
+		ogg_page_hdr hdr;
+		if (page_header_parse(clip.data() + at, clip.size() - at, &hdr) != OK
+			|| hdr.header_size + hdr.body_size > clip.size() - at)
+			return std::string(str_of_err(INVALID_DATA));
+		size_t size = hdr.header_size + hdr.body_size;
+		if (hdr.serial == serial) {
+			std::memmove(clip.data() + kept, clip.data() + at, size);
+			kept += size;
+		}
+		at += size;
+	}
+	clip.resize(kept);
+
+	PageWriter pages(clip, serial, seq);
+	int64_t last = packets.back().end_sample;
+	for (size_t i = 0; i < packets.size(); i++) {
+		int64_t granule = packets[i].end_sample - static_cast<int64_t>(start);
+		if (i + 1 == packets.size() && static_cast<uint64_t>(last) > end)
+			granule = static_cast<int64_t>(end - start);
+		// The primer's granule would be negative, so it shares the first
+		// page with the packet after it. That page is closed right away,
+		// to keep it from also being the last.
+		pages.Add(packets[i].data, granule, 2);
+		if (i == 1)
+			pages.Flush(i + 1 == packets.size());
+	}
+	pages.Flush(true);
+	return clip;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef _OV_FILE_H_
+#include "XiphTypes.h"
+#endif
+#include "oggvorbis.h"
+
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Cuts samples [start, end) out of an Ogg Vorbis stream without decoding
+// it, counting samples the way OggMap does. The stream's header pages are
+// copied as they are, followed by new pages holding the audio packets that
+// cover the range, plus the one before them that a decoder needs to prime
+// its overlap. Granule positions are rebased so the clip starts at zero,
+// and the first and last pages' granules tell the decoder to trim the
+// packets down to exactly the range, as at the start and end of any
+// stream. The input is scanned packet by packet up to `end`. A range
+// ending inside the first block after `start` can't be trimmed this way
+// and fails.
+//
+// Returns the clip as a complete Ogg file, or an error message.
+std::variant<std::string, std::vector<uint8_t>> ExtractOggClip(void* datasource, ov_callbacks callbacks,
+	uint64_t start, uint64_t end, const vorbis_options& options = vorbis_options());
@@ -3,77 +3,406 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
+#include <algorithm>
 
 #include "OggMap.h"
 #include "oggvorbis.h"
+#include "ByteOrder.h"
+#include "OggSource.h"
 
-void ComputeMap(vorbis_state* vs, OggMap &map) {
-	const uint32_t SEEK_INCREMENT = 0x8000;
+// Returns the error that ended the scan; normally READ_ERROR at EOF.
+template <class Source>
+err ComputeMap(vorbis_state* vs, Source& src, OggMap &map, const OggMapOptions& options) {
+	const uint32_t SEEK_INCREMENT = options.exact_pages ? 1 : options.seek_increment;
 	int64_t total_samples = 0;
-	std::vector<int64_t> seek_table;
+	struct SeekPoint {
+		uint32_t bytes;
+		int64_t samples;
+	};
+	std::vector<SeekPoint> seek_table;
 	
 	// Record the sample offset for every seek increment, and keep track
-	// of the total number of samples in the file.
+	// of the total number of samples in the file. Offsets are relative to
+	// the first page, so leading junk skipped by resync doesn't count; when
+	// mapping one stream of a chain, to the stream's first page.
+	const size_t base = vs->chain_offset;
 	uint32_t current_offset = 0;
-	for (uint32_t packet_num = 0; vorbis_next(vs) == OK; packet_num++) {
-		total_samples = vs->cur_page.granule_pos;
-		if (vs->cur_page_start >= current_offset 
-		 && vs->cur_packet_start >= current_offset
-		 && vs->cur_packet_start >= vs->cur_page_start) {
-			seek_table.push_back(vs->next_sample);
-			current_offset += SEEK_INCREMENT;
+	uint32_t regions_seen = vs->skipped_regions;
+	// For the prefetch table: each packet completes the samples from the
+	// previous one's next_sample up to its own, so every chunk those touch
+	// needs the page the packet ends on.
+	std::vector<OggMap::PrefetchEntry> prefetch;
+	int64_t prev_sample = vs->next_sample;
+	err e;
+	for (uint32_t packet_num = 0; (e = vorbis_next(vs, src)) == OK; packet_num++) {
+		total_samples = vs->chain_sample_base + vs->cur_page.granule_pos;
+		size_t page_start = vs->cur_page_start - base;
+		size_t packet_start = vs->cur_packet_start - base;
+		if (vs->skipped_regions != regions_seen) {
+			// A resync may have jumped over several increments at once.
+			regions_seen = vs->skipped_regions;
+			if (page_start > current_offset)
+				current_offset += (page_start - current_offset) / SEEK_INCREMENT * SEEK_INCREMENT;
+		}
+		if (vs->anchor_pending)
+			continue;
+		if (options.prefetch) {
+			uint32_t page_end = static_cast<uint32_t>(page_start + vs->cur_page.header_size + vs->cur_page.body_size);
+			uint32_t packet_size = static_cast<uint32_t>(vs->cur_packet.size);
+			if (vs->next_sample > prev_sample) {
+				size_t last = static_cast<size_t>((vs->next_sample - 1) / map.chunk_size);
+				if (prefetch.size() <= last)
+					prefetch.resize(last + 1, OggMap::PrefetchEntry{ 0, 0 });
+				for (size_t c = static_cast<size_t>(prev_sample / map.chunk_size); c <= last; c++) {
+					prefetch[c].end = page_end;
+					prefetch[c].max_packet = std::max(prefetch[c].max_packet, packet_size);
+				}
+			}
+			prev_sample = vs->next_sample;
+		}
+		if (page_start >= current_offset 
+		 && packet_start >= current_offset
+		 && packet_start >= page_start) {
+			if (options.exact_pages) {
+				// One point per page, at the page itself.
+				seek_table.push_back({ static_cast<uint32_t>(page_start), vs->next_sample });
+				current_offset = static_cast<uint32_t>(page_start) + 1;
+			} else {
+				seek_table.push_back({ current_offset, vs->next_sample });
+				current_offset += SEEK_INCREMENT;
+			}
 		}
   }
+	if (e == CANCELLED)
+		return e;
 
 	// Create a map entry of the closest offset for every chunk_size samples in the song.
+	// Both sequences only move forward, so one sweep over the seek table will do.
 	int64_t mogg_entries = (total_samples + (map.chunk_size - 1)) / map.chunk_size;
+	map.entries.reserve(mogg_entries);
+	size_t j = 0;
+	uint32_t current_bytes = 0;
+	uint32_t current_samples = 0;
 	for (int64_t i = 0; i < mogg_entries; i++) {
 		uint32_t desired_position = i * map.chunk_size;
-		uint32_t current_bytes = 0;
-    uint32_t current_samples = 0;
-		for(int j = 0; j < seek_table.size() && seek_table[j] < desired_position; ++j) {
-			current_bytes = j * SEEK_INCREMENT;
-      current_samples = seek_table[j];
+		for(; j < seek_table.size() && seek_table[j].samples < desired_position; ++j) {
+			current_bytes = seek_table[j].bytes;
+      current_samples = seek_table[j].samples;
 		}
 		map.entries.emplace_back(current_bytes, current_samples);
 	}
 	map.num_entries = map.entries.size();
+	if (options.prefetch) {
+		// Chunks no packet touched, inside a resync gap, end where the one
+		// before them does
+		prefetch.resize(map.entries.size(), OggMap::PrefetchEntry{ 0, 0 });
+		for (size_t c = 1; c < prefetch.size(); c++)
+			prefetch[c].end = std::max(prefetch[c].end, prefetch[c - 1].end);
+		map.prefetch = std::move(prefetch);
+	}
+	return e;
 }
 
 
-std::variant<std::string, OggMap> OggMap::Create(void* datasource, ov_callbacks callbacks) {
-	callbacks.seek_func(datasource, 0, SEEK_SET);
+static void FillReport(OggMap::ScanReport& report, const vorbis_state* vs, size_t data_offset) {
+	report.data_offset = data_offset;
+	report.skipped_bytes = vs->skipped_bytes;
+	report.skipped_regions = vs->skipped_regions;
+	report.crc_failures = vs->crc_failures;
+	report.page_digest = vs->page_digest;
+}
+
+template <class Source>
+std::variant<std::string, OggMap> OggMap::CreateFrom(Source& source, const OggMapOptions& options) {
+	if (options.chunk_size == 0 || (options.seek_increment == 0 && !options.exact_pages))
+		return std::string("Invalid OggMap options: chunk_size and seek_increment must be nonzero");
+	source.Seek(0);
 	vorbis_state* vs;
 	err e;
+	vorbis_options scan = options.scan;
+	scan.split_chains = false;
 	
-	if (e = vorbis_init(datasource, &vs, callbacks), e == OK)
+	if (e = vorbis_init(source, &vs, &scan), e == OK)
 	{
 		OggMap ret;
 		ret.version = 0x10;
-		ret.chunk_size = 20000;
-		ComputeMap(vs, ret);
+		ret.chunk_size = options.chunk_size;
+		e = ComputeMap(vs, source, ret, options);
+		FillReport(ret.report, vs, vs->data_offset);
 		vorbis_free(vs);
+		// Other errors just end the map, as damage at the tail always has,
+		// but a failed integrity check or a cancel must not go unnoticed.
+		if (e == BAD_CHECKSUM || e == CANCELLED)
+			return std::string("Could not map vorbis: ") + str_of_err(e);
 		return ret;
 	}
 	return std::string("Could not init vorbis: ") + str_of_err(e);
 }
 
-size_t OggMap::GetLength() {
+template <class Source>
+std::variant<std::string, std::vector<OggMap>> OggMap::CreateChainsFrom(Source& source, const OggMapOptions& options) {
+	if (options.chunk_size == 0 || (options.seek_increment == 0 && !options.exact_pages))
+		return std::string("Invalid OggMap options: chunk_size and seek_increment must be nonzero");
+	source.Seek(0);
+	vorbis_state* vs;
+	err e;
+	vorbis_options scan = options.scan;
+	scan.split_chains = true;
+
+	if (e = vorbis_init(source, &vs, &scan), e != OK)
+		return std::string("Could not init vorbis: ") + str_of_err(e);
+	std::vector<OggMap> maps;
+	do {
+		OggMap map;
+		map.version = 0x10;
+		map.chunk_size = options.chunk_size;
+		size_t chain_offset = vs->chain_offset;
+		e = ComputeMap(vs, source, map, options);
+		FillReport(map.report, vs, chain_offset);
+		maps.push_back(std::move(map));
+	} while (e == CHAIN_BOUNDARY);
+	vorbis_free(vs);
+	if (e == BAD_CHECKSUM || e == CANCELLED)
+		return std::string("Could not map vorbis: ") + str_of_err(e);
+	return maps;
+}
+
+template std::variant<std::string, OggMap> OggMap::CreateFrom(MemorySource&, const OggMapOptions&);
+template std::variant<std::string, OggMap> OggMap::CreateFrom(CallbackSource&, const OggMapOptions&);
+template std::variant<std::string, std::vector<OggMap>> OggMap::CreateChainsFrom(MemorySource&, const OggMapOptions&);
+template std::variant<std::string, std::vector<OggMap>> OggMap::CreateChainsFrom(CallbackSource&, const OggMapOptions&);
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+template std::variant<std::string, OggMap> OggMap::CreateFrom(FdSource&, const OggMapOptions&);
+template std::variant<std::string, std::vector<OggMap>> OggMap::CreateChainsFrom(FdSource&, const OggMapOptions&);
+#endif
+
+std::variant<std::string, OggMap> OggMap::Create(void* datasource, ov_callbacks callbacks,
+                                                 const OggMapOptions& options) {
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+	// Our own pread datasource can be scanned without the callbacks.
+	if (callbacks.read_func == fdCallbacks.read_func) {
+		FdSource source(static_cast<FdDatasource*>(datasource));
+		return CreateFrom(source, options);
+	}
+#endif
+	CallbackSource source(datasource, callbacks);
+	return CreateFrom(source, options);
+}
+
+std::variant<std::string, std::vector<OggMap>> OggMap::CreateChains(void* datasource, ov_callbacks callbacks,
+                                                                    const OggMapOptions& options) {
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+	if (callbacks.read_func == fdCallbacks.read_func) {
+		FdSource source(static_cast<FdDatasource*>(datasource));
+		return CreateChainsFrom(source, options);
+	}
+#endif
+	CallbackSource source(datasource, callbacks);
+	return CreateChainsFrom(source, options);
+}
+
+std::variant<std::string, std::vector<OggMap>> OggMap::CreateChains(const void* data, size_t length,
+                                                                    const OggMapOptions& options) {
+	MemorySource source(data, length);
+	return CreateChainsFrom(source, options);
+}
+
+std::variant<std::string, OggMap> OggMap::Create(const void* data, size_t length,
+                                                 const OggMapOptions& options) {
+	MemorySource source(data, length);
+	return CreateFrom(source, options);
+}
+
+size_t OggMap::GetLength() const {
 	return 12 + (entries.size() * 8);
 }
 
-// Not endian-safe.
-std::vector<char> OggMap::Serialize() {
+std::vector<char> OggMap::Serialize() const {
 	std::vector<char> ret;
 	ret.resize(GetLength());
-	int* ints = (int*)ret.data();
-	ints[0] = version;
-	ints[1] = chunk_size;
-	ints[2] = num_entries;
-	for (int i = 0; i < num_entries; i++)
+	SerializeTo(ret.data(), ret.size());
+	return ret;
+}
+
+size_t OggMap::SerializeTo(void* out, size_t capacity) const {
+	static_assert(sizeof(Entry) == 8, "Entry must be two packed uint32_t");
+	size_t length = GetLength();
+	if (capacity < length)
+		return 0;
+	uint8_t* p = static_cast<uint8_t*>(out);
+	store_le32(p, version);
+	store_le32(p + 4, chunk_size);
+	store_le32(p + 8, static_cast<uint32_t>(entries.size()));
+	// The table goes out in one copy, plus one pass of byte swaps on
+	// big-endian hosts.
+	memcpy(p + 12, entries.data(), entries.size() * sizeof(Entry));
+	le32_swap_words(p + 12, entries.size() * 2);
+	return length;
+}
+
+std::vector<uint8_t> OggMap::SerializePrefetch(uint32_t ogg_offset) const {
+	std::vector<uint8_t> ret(PrefetchView::HEADER_SIZE + entries.size() * PrefetchView::ENTRY_SIZE);
+	uint8_t* p = ret.data();
+	store_le32(p, PrefetchView::VERSION);
+	store_le32(p + 4, chunk_size);
+	store_le32(p + 8, static_cast<uint32_t>(entries.size()));
+	store_le32(p + 12, ogg_offset);
+	p += PrefetchView::HEADER_SIZE;
+	for (size_t i = 0; i < entries.size(); i++, p += PrefetchView::ENTRY_SIZE) {
+		PrefetchEntry extra = i < prefetch.size() ? prefetch[i] : PrefetchEntry{ 0, 0 };
+		store_le32(p, entries[i].bytes);
+		store_le32(p + 4, entries[i].samples);
+		store_le32(p + 8, extra.end);
+		store_le32(p + 12, extra.max_packet);
+	}
+	return ret;
+}
+
+std::variant<std::string, OggMap> OggMap::Deserialize(const void* data, size_t length) {
+	OggMapView view;
+	if (!view.Parse(data, length))
+		return std::string("OggMap is truncated");
+	OggMap ret;
+	ret.version = view.version;
+	ret.chunk_size = view.chunk_size;
+	ret.num_entries = view.num_entries;
+	ret.entries.reserve(ret.num_entries);
+	for (uint32_t i = 0; i < ret.num_entries; i++)
 	{
-		ints[3 + (i * 2)] = entries[i].bytes;
-		ints[3 + (i * 2) + 1] = entries[i].samples;
+		ret.entries.push_back(view.GetEntry(i));
 	}
 	return ret;
-}
\ No newline at end of file
+}
+
+std::string ReadMoggHeader(void* datasource, ov_callbacks callbacks, std::vector<uint8_t>& header) {
+	uint8_t mogg_header[8];
+	callbacks.seek_func(datasource, 0, SEEK_SET);
+	if (callbacks.read_func(mogg_header, sizeof(mogg_header), 1, datasource) != 1)
+		return "Unable to read mogg header.";
+	uint32_t header_length = load_le32(mogg_header + 4);
+	if (header_length < sizeof(mogg_header) || header_length > MAX_MOGG_HEADER)
+		return "Invalid mogg header length.";
+	header.resize(header_length);
+	memcpy(header.data(), mogg_header, sizeof(mogg_header));
+	size_t rest = header_length - sizeof(mogg_header);
+	if (callbacks.read_func(header.data() + sizeof(mogg_header), 1, rest, datasource) != rest)
+		return "Unable to read mogg header.";
+	return std::string();
+}
+
+std::variant<std::string, OggMap> OggMap::ReadFromMogg(void* datasource, ov_callbacks callbacks,
+                                                       size_t* ogg_offset) {
+	std::vector<uint8_t> header;
+	std::string error = ReadMoggHeader(datasource, callbacks, header);
+	if (!error.empty())
+		return error;
+	OggMapView view;
+	if (!view.ParseMogg(header.data(), header.size(), ogg_offset))
+		return std::string("Unsupported mogg version or damaged OggMap.");
+	return Deserialize(view.data, view.GetLength());
+}
+
+namespace {
+
+// Entries are in sample order; find the first one past the target. The
+// one before it is where to decode from.
+template <class GetEntry>
+uint32_t EntriesUpTo(uint32_t count, uint64_t sample, GetEntry get) {
+	uint32_t lo = 0, hi = count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (get(mid).samples <= sample)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Before the first entry, decode from the very start.
+template <class GetEntry>
+OggMap::Entry LookupEntry(uint32_t count, uint64_t sample, GetEntry get) {
+	uint32_t n = EntriesUpTo(count, sample, get);
+	return n == 0 ? OggMap::Entry(0, 0) : get(n - 1);
+}
+
+}
+
+OggMap::Entry OggMap::Lookup(uint64_t sample) const {
+	return LookupEntry(static_cast<uint32_t>(entries.size()), sample,
+		[this](uint32_t i) { return entries[i]; });
+}
+
+bool OggMapView::Parse(const void* map, size_t length) {
+	if (length < 12)
+		return false;
+	const uint8_t* p = static_cast<const uint8_t*>(map);
+	uint32_t count = load_le32(p + 8);
+	if (count > (length - 12) / 8)
+		return false;
+	data = p;
+	version = load_le32(p);
+	chunk_size = load_le32(p + 4);
+	num_entries = count;
+	return true;
+}
+
+bool OggMapView::ParseMogg(const void* header, size_t length, size_t* ogg_offset) {
+	if (length < 8)
+		return false;
+	const uint8_t* p = static_cast<const uint8_t*>(header);
+	uint32_t mogg_version = load_le32(p);
+	uint32_t header_length = load_le32(p + 4);
+	if (mogg_version != 0xA && mogg_version != 0xB)
+		return false;
+	// The map must end inside the header, before the IV of an 0xB.
+	size_t map_space = std::min<size_t>(length, header_length);
+	size_t iv_length = mogg_version == 0xB ? 16 : 0;
+	if (map_space < 8 + iv_length || !Parse(p + 8, map_space - 8 - iv_length))
+		return false;
+	if (ogg_offset)
+		*ogg_offset = header_length;
+	return true;
+}
+
+OggMap::Entry OggMapView::GetEntry(uint32_t i) const {
+	const uint8_t* e = data + 12 + static_cast<size_t>(i) * 8;
+	return OggMap::Entry(load_le32(e), load_le32(e + 4));
+}
+
+OggMap::Entry OggMapView::Lookup(uint64_t sample) const {
+	return LookupEntry(num_entries, sample, [this](uint32_t i) { return GetEntry(i); });
+}
+
+bool PrefetchView::Parse(const void* table, size_t length) {
+	if (length < HEADER_SIZE)
+		return false;
+	const uint8_t* p = static_cast<const uint8_t*>(table);
+	uint32_t count = load_le32(p + 8);
+	if (load_le32(p) != VERSION || load_le32(p + 4) == 0 || count > (length - HEADER_SIZE) / ENTRY_SIZE)
+		return false;
+	data = p;
+	chunk_size = load_le32(p + 4);
+	num_entries = count;
+	ogg_offset = load_le32(p + 12);
+	return true;
+}
+
+bool PrefetchView::Lookup(uint64_t start, uint64_t end, Range& out) const {
+	if (start >= end || start / chunk_size >= num_entries)
+		return false;
+	auto entry = [this](uint32_t i) { return data + HEADER_SIZE + static_cast<size_t>(i) * ENTRY_SIZE; };
+	uint32_t n = EntriesUpTo(num_entries, start, [&](uint32_t i) {
+		return OggMap::Entry(load_le32(entry(i)), load_le32(entry(i) + 4));
+	});
+	uint32_t first = static_cast<uint32_t>(std::min<uint64_t>(start / chunk_size, n ? n - 1 : 0));
+	uint32_t last = static_cast<uint32_t>(std::min<uint64_t>((end - 1) / chunk_size, num_entries - 1));
+	uint32_t begin = n ? load_le32(entry(n - 1)) : 0;
+	out.begin = ogg_offset + static_cast<uint64_t>(begin);
+	out.end = ogg_offset + static_cast<uint64_t>(std::max(begin, load_le32(entry(last) + 8)));
+	out.sample = n ? load_le32(entry(n - 1) + 4) : 0;
+	out.max_packet = 0;
+	for (uint32_t c = first; c <= last; c++)
+		out.max_packet = std::max(out.max_packet, load_le32(entry(c) + 12));
+	return true;
+}
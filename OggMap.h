@@ -9,14 +9,59 @@
 #include "XiphTypes.h"
 #endif
 #include <cstdint>
+#include "oggvorbis.h"
+
+struct OggMapOptions {
+  // Options for the underlying Vorbis scanner.
+  vorbis_options scan{};
+  // Samples between map entries. Smaller values mean a larger header but
+  // less audio to decode and discard after a seek.
+  uint32_t chunk_size = 20000;
+  // Byte granularity of the seek points the entries are picked from.
+  uint32_t seek_increment = 0x8000;
+  // Use the exact start of every page as a seek point instead of rounding
+  // down to seek_increment.
+  bool exact_pages = false;
+  // Also fill in OggMap::prefetch, in the same scan.
+  bool prefetch = false;
+};
 
 struct OggMap {
   // Create an OggMap from an ogg vorbis file.
-  static std::variant<std::string, OggMap> Create(void* datasource, ov_callbacks callbacks);
+  static std::variant<std::string, OggMap> Create(void* datasource, ov_callbacks callbacks,
+                                                  const OggMapOptions& options = OggMapOptions());
+  // Create an OggMap from an ogg vorbis file already in memory.
+  static std::variant<std::string, OggMap> Create(const void* data, size_t length,
+                                                  const OggMapOptions& options = OggMapOptions());
+  // Create an OggMap by scanning one of the sources in OggSource.h, which
+  // inline into the scanner. Pass an MmapSource as a MemorySource.
+  template <class Source>
+  static std::variant<std::string, OggMap> CreateFrom(Source& source,
+                                                      const OggMapOptions& options = OggMapOptions());
+  // Create one OggMap for each stream of a chained ogg vorbis file, each
+  // relative to its stream's first page and first sample. Create maps the
+  // whole file as one stream instead, counting samples on across chains.
+  static std::variant<std::string, std::vector<OggMap>> CreateChains(void* datasource, ov_callbacks callbacks,
+                                                                     const OggMapOptions& options = OggMapOptions());
+  static std::variant<std::string, std::vector<OggMap>> CreateChains(const void* data, size_t length,
+                                                                     const OggMapOptions& options = OggMapOptions());
+  template <class Source>
+  static std::variant<std::string, std::vector<OggMap>> CreateChainsFrom(Source& source,
+                                                                         const OggMapOptions& options = OggMapOptions());
   // The length in bytes of this when serialized.
-  size_t GetLength();
+  size_t GetLength() const;
   // Serializes this into a byte array.
-  std::vector<char> Serialize();
+  std::vector<char> Serialize() const;
+  // Serializes this, little-endian, straight into `out`, which can be part
+  // of a larger header or an output mapping. Returns the bytes written, or
+  // 0 if capacity is less than GetLength().
+  size_t SerializeTo(void* out, size_t capacity) const;
+  // Parses a map in the format written by Serialize.
+  static std::variant<std::string, OggMap> Deserialize(const void* data, size_t length);
+  // Reads the map from the header of an 0xA or 0xB mogg. If ogg_offset is
+  // given, it receives the file offset where the Ogg data starts.
+  static std::variant<std::string, OggMap> ReadFromMogg(void* datasource, ov_callbacks callbacks,
+                                                        size_t* ogg_offset = nullptr);
 
   uint32_t version;
   uint32_t chunk_size;
@@ -27,4 +72,96 @@ struct OggMap {
     uint32_t samples;
   };
   std::vector<Entry> entries;
-};
\ No newline at end of file
+
+  // The entry to start decoding from to reach `sample`: the last one at or
+  // before it. Entry bytes are relative to the start of the Ogg data.
+  Entry Lookup(uint64_t sample) const;
+
+  // With OggMapOptions::prefetch, one per entry: where the pages needed to
+  // decode the entry's chunk end, relative to the Ogg data like the entry,
+  // and the size of the chunk's largest packet. Lets a streaming consumer
+  // fetch exactly the bytes a window of samples needs. Not part of the map.
+  struct PrefetchEntry {
+    uint32_t end;
+    uint32_t max_packet;
+  };
+  std::vector<PrefetchEntry> prefetch;
+
+  // Serializes the entries together with their prefetch entries, as read
+  // by PrefetchView, for a mogg whose Ogg data starts at `ogg_offset`: the
+  // version (1), chunk size, entry count and ogg_offset, then each entry's
+  // bytes, samples, end and max_packet, all 32-bit little-endian.
+  std::vector<uint8_t> SerializePrefetch(uint32_t ogg_offset) const;
+
+  // What the scan that built this map found in the input. Not serialized.
+  struct ScanReport {
+    // Input offset of the first Ogg page; anything before it is junk. For
+    // a map from CreateChains, the offset of its stream's first page.
+    size_t data_offset;
+    uint64_t skipped_bytes;
+    uint32_t skipped_regions;
+    // Pages whose CRC didn't match, when verify_crc is set.
+    uint32_t crc_failures;
+    // page_digest_add over every page that was read.
+    uint64_t page_digest;
+  } report{};
+};
+
+// Upper bound on the header size ReadFromMogg will accept, to reject
+// garbage offsets before allocating for them.
+constexpr uint32_t MAX_MOGG_HEADER = 64 * 1024 * 1024;
+
+// Reads the header of a mogg, everything before the Ogg data, into
+// `header`. Returns an empty string on success, otherwise the error.
+std::string ReadMoggHeader(void* datasource, ov_callbacks callbacks, std::vector<uint8_t>& header);
+
+// A read-only view of a serialized OggMap, for instance inside a memory-
+// mapped mogg. Nothing is copied, so the memory must outlive the view.
+struct OggMapView {
+  // Points the view at a map in the format written by Serialize. Returns
+  // false if `length` bytes can't hold it.
+  bool Parse(const void* map, size_t length);
+  // Points the view at the map in an 0xA or 0xB mogg header. If ogg_offset
+  // is given, it receives the file offset where the Ogg data starts.
+  bool ParseMogg(const void* header, size_t length, size_t* ogg_offset = nullptr);
+
+  size_t GetLength() const { return 12 + static_cast<size_t>(num_entries) * 8; }
+  OggMap::Entry GetEntry(uint32_t i) const;
+  // As OggMap::Lookup.
+  OggMap::Entry Lookup(uint64_t sample) const;
+
+  const uint8_t* data = nullptr;
+  uint32_t version = 0;
+  uint32_t chunk_size = 0;
+  uint32_t num_entries = 0;
+};
+
+// A read-only view of a table written by OggMap::SerializePrefetch.
+struct PrefetchView {
+  // Points the view at a table. Returns false if it isn't one.
+  bool Parse(const void* table, size_t length);
+
+  struct Range {
+    // The bytes of the mogg file to fetch, [begin, end).
+    uint64_t begin;
+    uint64_t end;
+    // The sample decoding from `begin` starts at.
+    uint32_t sample;
+    // The largest packet among the chunks the range covers.
+    uint32_t max_packet;
+  };
+  // The bytes needed to decode samples [start, end): from the seek point a
+  // decoder would start at for `start` to the end of the page completing
+  // sample end - 1. Returns false if the window is empty or starts past
+  // the last chunk.
+  bool Lookup(uint64_t start, uint64_t end, Range& out) const;
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr size_t ENTRY_SIZE = 16;
+
+  const uint8_t* data = nullptr;
+  uint32_t chunk_size = 0;
+  uint32_t num_entries = 0;
+  uint32_t ogg_offset = 0;
+};
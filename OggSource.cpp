@@ -0,0 +1,35 @@
+#include "OggSource.h"
+
+#if defined(MOGG_HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MmapSource::MmapSource(const char* path) : MemorySource(nullptr, 0) {
+	int flags = O_RDONLY;
+#if defined(O_CLOEXEC)
+	flags |= O_CLOEXEC;
+#endif
+	int fd = open(path, flags);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			// The scan is one forward pass.
+			madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+			data = static_cast<const uint8_t*>(p);
+			size = static_cast<size_t>(st.st_size);
+		}
+	}
+	// The mapping stays valid without the descriptor.
+	close(fd);
+}
+
+MmapSource::~MmapSource() {
+	if (data)
+		munmap(const_cast<uint8_t*>(data), size);
+}
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+
+#ifndef _OV_FILE_H_
+#include "XiphTypes.h"
+#endif
+#include "FdDatasource.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Inputs the Vorbis scanner can be instantiated on directly, instead of
+// going through ov_callbacks function pointers. Each provides:
+//
+//   size_t Read(void* dst, size_t n)   copy up to n bytes and advance
+//   bool Seek(uint64_t pos)            move to an absolute offset
+//   uint64_t Tell() const
+//   const uint8_t* Peek(size_t n, size_t* avail)
+//       point at the next min(n, bytes left) bytes without copying or
+//       advancing, setting *avail to that count. Returns NULL if the source
+//       can't; the pointer is valid until the next call on the source.
+//   void Skip(size_t n)                advance past bytes seen through Peek
+//
+// Peek lets whole pages be scanned in place rather than copied.
+
+// A file already in memory.
+struct MemorySource {
+	MemorySource(const void* data, size_t size)
+		: data(static_cast<const uint8_t*>(data)), size(size) {}
+
+	size_t Read(void* dst, size_t n) {
+		size_t avail;
+		const uint8_t* p = Peek(n, &avail);
+		memcpy(dst, p, avail);
+		pos += avail;
+		return avail;
+	}
+	bool Seek(uint64_t to) {
+		pos = to;
+		return true;
+	}
+	uint64_t Tell() const { return pos; }
+	const uint8_t* Peek(size_t n, size_t* avail) const {
+		size_t left = pos < size ? static_cast<size_t>(size - pos) : 0;
+		*avail = n < left ? n : left;
+		return data + (pos < size ? pos : size);
+	}
+	void Skip(size_t n) { pos += n; }
+
+	const uint8_t* data;
+	size_t size;
+	uint64_t pos = 0;
+};
+
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+#define MOGG_HAVE_MMAP 1
+
+// A file mapped into memory. Check data after construction: it is NULL if
+// the file couldn't be mapped (e.g. it is empty, or on a filesystem that
+// doesn't support it), in which case fall back to FdSource.
+struct MmapSource : MemorySource {
+	explicit MmapSource(const char* path);
+	~MmapSource();
+	MmapSource(const MmapSource&) = delete;
+	MmapSource& operator=(const MmapSource&) = delete;
+};
+
+// An FdDatasource, peeking straight into its buffer.
+struct FdSource {
+	explicit FdSource(FdDatasource* fd) : fd(fd) {}
+
+	size_t Read(void* dst, size_t n) {
+		size_t avail;
+		const uint8_t* p = Buffered(&avail);
+		if (avail >= n) {
+			memcpy(dst, p, n);
+			fd->pos += n;
+			return n;
+		}
+		return fd_datasource_read(fd, dst, n);
+	}
+	bool Seek(uint64_t to) {
+		fd->pos = to;
+		return true;
+	}
+	uint64_t Tell() const { return fd->pos; }
+	const uint8_t* Peek(size_t n, size_t* avail) {
+		const uint8_t* p = Buffered(avail);
+		// A short buffer that ends the file can't get any longer.
+		bool at_end = fd->buffer_length > 0 && fd->buffer_length < fd->buffer_capacity;
+		if (*avail >= n) {
+			*avail = n;
+			return p;
+		}
+		if (at_end && p)
+			return p;
+		if (n > fd->buffer_capacity)
+			return nullptr;
+		fd_datasource_fill(fd);
+		*avail = fd->buffer_length < n ? fd->buffer_length : n;
+		return fd->buffer;
+	}
+	void Skip(size_t n) { fd->pos += n; }
+
+	FdDatasource* fd;
+
+private:
+	// The buffered bytes from the current offset on, if it is in the buffer.
+	const uint8_t* Buffered(size_t* avail) const {
+		if (fd->pos < fd->buffer_start || fd->pos > fd->buffer_start + fd->buffer_length) {
+			*avail = 0;
+			return nullptr;
+		}
+		size_t at = static_cast<size_t>(fd->pos - fd->buffer_start);
+		*avail = fd->buffer_length - at;
+		return fd->buffer + at;
+	}
+};
+#endif
+
+// Any ov_callbacks datasource. Nothing inlines past the function pointers,
+// but it keeps every existing input working.
+struct CallbackSource {
+	CallbackSource(void* datasource, ov_callbacks callbacks)
+		: datasource(datasource), callbacks(callbacks) {}
+
+	size_t Read(void* dst, size_t n) { return callbacks.read_func(dst, 1, n, datasource); }
+	bool Seek(uint64_t to) {
+		return callbacks.seek_func(datasource, static_cast<ogg_int64_t>(to), SEEK_SET) == 0;
+	}
+	uint64_t Tell() const { return static_cast<uint64_t>(callbacks.tell_func(datasource)); }
+	const uint8_t* Peek(size_t, size_t* avail) const {
+		*avail = 0;
+		return nullptr;
+	}
+	void Skip(size_t) {}
+
+	void* datasource;
+	ov_callbacks callbacks;
+};
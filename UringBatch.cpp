@@ -0,0 +1,596 @@
+#include "UringBatch.h"
+
+#if !defined(MOGG_HAVE_IO_URING)
+
+bool RunUringBatch(std::vector<BatchJob>&, const OggMapOptions&, const IvOptions&, size_t) {
+    return false;
+}
+
+#else
+#include "ByteOrder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned QUEUE_DEPTH = 128;
+// Reads and writes are split into segments of this size, so several files
+// progress at once and no single request is unreasonably large.
+constexpr size_t SEGMENT_SIZE = 1 << 20;
+// Files being read, mapped or written at the same time.
+constexpr size_t MAX_ACTIVE = 32;
+
+// Just enough of io_uring to queue reads and writes and reap completions,
+// on the raw system calls rather than liburing.
+class Uring
+{
+public:
+    ~Uring() { Close(); }
+
+    void Close() {
+        if (sqes)
+            munmap(sqes, sqes_size);
+        if (cq_ptr && cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_size);
+        if (sq_ptr)
+            munmap(sq_ptr, sq_size);
+        if (fd >= 0)
+            close(fd);
+        sqes = nullptr;
+        cq_ptr = sq_ptr = nullptr;
+        fd = -1;
+    }
+
+    bool Init(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0)
+            return false;
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = false;
+#if defined(IORING_FEAT_SINGLE_MMAP)
+        single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sq_size = cq_size = std::max(sq_size, cq_size);
+#endif
+        sq_ptr = Map(sq_size, IORING_OFF_SQ_RING);
+        if (!sq_ptr)
+            return false;
+        cq_ptr = single ? sq_ptr : Map(cq_size, IORING_OFF_CQ_RING);
+        if (!cq_ptr)
+            return false;
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(Map(sqes_size, IORING_OFF_SQES));
+        if (!sqes)
+            return false;
+        auto* sq = static_cast<uint8_t*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        auto* cq = static_cast<uint8_t*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        sq_entries = p.sq_entries;
+        local_tail = *sq_tail;
+        return true;
+    }
+
+    // Pins `len` bytes at `base` so reads and writes into them can skip
+    // the per-request page mapping. Fails under a low RLIMIT_MEMLOCK.
+    bool RegisterBuffer(void* base, size_t len) {
+        iovec iov = { base, len };
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    }
+
+    // A zeroed submission entry, or NULL if as many requests as the queue
+    // holds are already in flight.
+    io_uring_sqe* GetSqe() {
+        if (in_flight + pending >= sq_entries)
+            return nullptr;
+        unsigned index = local_tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        local_tail++;
+        pending++;
+        return sqe;
+    }
+
+    // Submits what was queued and, if wait is set, blocks until at least
+    // one request completes.
+    bool Submit(bool wait) {
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        for (;;) {
+            unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+            long n = syscall(__NR_io_uring_enter, fd, pending, wait ? 1 : 0, flags, nullptr, 0);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            pending -= static_cast<unsigned>(n);
+            in_flight += static_cast<unsigned>(n);
+            if (pending == 0 || !wait)
+                return true;
+        }
+    }
+
+    // Blocks until a request completes, without submitting anything.
+    bool Wait() {
+        for (;;) {
+            long n = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (n >= 0)
+                return true;
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    // Takes back the entries queued but not yet taken by the kernel,
+    // calling drop(user_data) for each.
+    template <class Drop>
+    void Unqueue(Drop drop) {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        for (unsigned i = head; i != local_tail; i++)
+            drop(sqes[sq_array[i & sq_mask]].user_data);
+        local_tail = head;
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        pending = 0;
+    }
+
+    // Calls handle(user_data, res) for every completion ready now.
+    template <class Handle>
+    void Reap(Handle handle) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes[head & cq_mask];
+            head++;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            in_flight--;
+            handle(cqe.user_data, cqe.res);
+        }
+    }
+
+    unsigned in_flight = 0;
+    unsigned pending = 0;
+
+private:
+    void* Map(size_t len, off_t offset) {
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int fd = -1;
+    void* sq_ptr = nullptr;
+    size_t sq_size = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned sq_entries = 0;
+    unsigned local_tail = 0;
+};
+
+// First-fit allocation of page-aligned slices of the arena.
+class ArenaSlices
+{
+public:
+    explicit ArenaSlices(size_t size) { free_slices[0] = size; }
+
+    bool Alloc(size_t len, size_t* offset) {
+        len = (len + 4095) & ~static_cast<size_t>(4095);
+        for (auto it = free_slices.begin(); it != free_slices.end(); ++it) {
+            if (it->second < len)
+                continue;
+            *offset = it->first;
+            size_t rest = it->second - len;
+            free_slices.erase(it);
+            if (rest)
+                free_slices[*offset + len] = rest;
+            return true;
+        }
+        return false;
+    }
+
+    void Free(size_t offset, size_t len) {
+        len = (len + 4095) & ~static_cast<size_t>(4095);
+        auto it = free_slices.emplace(offset, len).first;
+        auto next = std::next(it);
+        if (next != free_slices.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            free_slices.erase(next);
+        }
+        if (it != free_slices.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                free_slices.erase(it);
+            }
+        }
+    }
+
+private:
+    std::map<size_t, size_t> free_slices;
+};
+
+struct MemoryFile {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+};
+
+ov_callbacks memoryCallbacks = {
+    [](void* ptr, size_t size, size_t nmemb, void* datasource) -> size_t {
+        auto* f = static_cast<MemoryFile*>(datasource);
+        size_t n = std::min(size * nmemb, f->size - std::min(f->pos, f->size)) / size;
+        memcpy(ptr, f->data + f->pos, n * size);
+        f->pos += n * size;
+        return n;
+    },
+    [](void* datasource, ogg_int64_t offset, int whence) -> int {
+        auto* f = static_cast<MemoryFile*>(datasource);
+        ogg_int64_t base = whence == SEEK_CUR ? f->pos : whence == SEEK_END ? f->size : 0;
+        if (base + offset < 0)
+            return -1;
+        f->pos = static_cast<size_t>(base + offset);
+        return 0;
+    },
+    nullptr,
+    [](void* datasource) -> long { return static_cast<long>(static_cast<MemoryFile*>(datasource)->pos); },
+};
+
+// A file in the batch from the moment it is opened until it is written.
+struct ActiveJob {
+    BatchJob* job;
+    int in_fd = -1;
+    int out_fd = -1;
+    size_t slice = 0;
+    uint8_t* data = nullptr;
+    uint64_t size = 0;
+    bool writing = false;
+    uint64_t next_read = 0;
+    // The output is `header` followed by payload_length bytes at `payload`.
+    std::vector<uint8_t> header;
+    uint8_t* payload = nullptr;
+    uint64_t payload_length = 0;
+    uint64_t next_write = 0;
+    unsigned pending = 0;
+    int error = 0;
+
+    uint64_t OutputSize() const { return header.size() + payload_length; }
+};
+
+// One read or write in flight; its address is the request's user_data.
+struct Request {
+    ActiveJob* active;
+    bool write;
+    uint64_t file_offset;
+    uint8_t* buf;
+    size_t length;
+    bool fixed;
+    iovec iov;
+};
+
+class Batch
+{
+public:
+    Batch(Uring& ring, uint8_t* arena, size_t arena_size, bool registered,
+          const OggMapOptions& mapOptions, const IvOptions& iv)
+        : ring(ring), arena(arena), arena_size(arena_size), slices(arena_size),
+          registered(registered), map_options(mapOptions), iv(iv) {}
+
+    // Returns false if the ring failed with requests it never completed,
+    // which may still write into the arena.
+    bool Run(std::vector<BatchJob>& jobs) {
+        size_t next_job = 0;
+        while (next_job < jobs.size() || !active.empty()) {
+            while (next_job < jobs.size() && active.size() < MAX_ACTIVE) {
+                if (!Admit(jobs[next_job]))
+                    break;
+                next_job++;
+            }
+            for (auto it = active.begin(); it != active.end();) {
+                if (Advance(**it))
+                    it = active.erase(it);
+                else
+                    ++it;
+            }
+            // Hand out queue slots round-robin so every file keeps moving.
+            bool queued = true;
+            while (queued) {
+                queued = false;
+                for (auto& a : active)
+                    queued |= QueueNext(*a);
+            }
+            if (ring.pending + ring.in_flight == 0)
+                continue;
+            if (!ring.Submit(true))
+                break;
+            ReapAll();
+        }
+        // If the ring broke down, whatever is left goes back to the caller,
+        // once the requests already taken by the kernel are done with.
+        bool drained = true;
+        if (!active.empty()) {
+            for (auto& a : active)
+                a->error = -1;
+            ring.Unqueue([](uint64_t user_data) { delete reinterpret_cast<Request*>(user_data); });
+            while (ring.in_flight > 0 && (drained = ring.Wait()))
+                ReapAll();
+        }
+        for (auto& a : active) {
+            close(a->in_fd);
+            close(a->out_fd);
+            a->job->result = -1;
+        }
+        for (; next_job < jobs.size(); next_job++)
+            jobs[next_job].result = -1;
+        return drained;
+    }
+
+private:
+    // Opens a job and reserves room for it. Returns false if the arena is
+    // too full right now; the job then waits for others to finish.
+    bool Admit(BatchJob& job) {
+        int in_fd = open(job.input_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            job.result = 1;
+            return true;
+        }
+        struct stat st;
+        if (fstat(in_fd, &st) != 0) {
+            close(in_fd);
+            job.result = 1;
+            return true;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size > arena_size) {
+            // Never fits; leave it for the caller's one-by-one path.
+            close(in_fd);
+            job.result = -1;
+            return true;
+        }
+        size_t slice;
+        if (!slices.Alloc(size ? size : 1, &slice)) {
+            close(in_fd);
+            return false;
+        }
+        int out_fd = open(job.output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0) {
+            close(in_fd);
+            slices.Free(slice, size ? size : 1);
+            job.result = 2;
+            return true;
+        }
+        std::unique_ptr<ActiveJob> a(new ActiveJob());
+        a->job = &job;
+        a->in_fd = in_fd;
+        a->out_fd = out_fd;
+        a->slice = slice;
+        a->data = arena + slice;
+        a->size = size;
+        active.push_back(std::move(a));
+        return true;
+    }
+
+    // Queues the next segment to read or write for a job. Returns false if
+    // there is none right now, or the queue is full.
+    bool QueueNext(ActiveJob& a) {
+        if (a.error)
+            return false;
+        uint64_t offset;
+        uint8_t* buf;
+        size_t length;
+        bool fixed = registered;
+        if (!a.writing) {
+            if (a.next_read >= a.size)
+                return false;
+            offset = a.next_read;
+            buf = a.data + offset;
+            length = static_cast<size_t>(std::min<uint64_t>(SEGMENT_SIZE, a.size - offset));
+        } else {
+            if (a.next_write >= a.OutputSize())
+                return false;
+            offset = a.next_write;
+            if (offset < a.header.size()) {
+                // The header lives outside the arena.
+                buf = a.header.data() + offset;
+                length = static_cast<size_t>(a.header.size() - offset);
+                fixed = false;
+            } else {
+                buf = a.payload + (offset - a.header.size());
+                length = static_cast<size_t>(std::min<uint64_t>(SEGMENT_SIZE, a.OutputSize() - offset));
+            }
+        }
+        if (!Queue(a, a.writing, offset, buf, length, fixed))
+            return false;
+        (a.writing ? a.next_write : a.next_read) += length;
+        return true;
+    }
+
+    bool Queue(ActiveJob& a, bool write, uint64_t offset, uint8_t* buf, size_t length, bool fixed) {
+        io_uring_sqe* sqe = ring.GetSqe();
+        if (!sqe)
+            return false;
+        auto* r = new Request{ &a, write, offset, buf, length, fixed, { buf, length } };
+        sqe->fd = write ? a.out_fd : a.in_fd;
+        sqe->off = offset;
+        if (fixed) {
+            sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->addr = reinterpret_cast<uint64_t>(buf);
+            sqe->len = static_cast<uint32_t>(length);
+            sqe->buf_index = 0;
+        } else {
+            sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe->addr = reinterpret_cast<uint64_t>(&r->iov);
+            sqe->len = 1;
+        }
+        sqe->user_data = reinterpret_cast<uint64_t>(r);
+        a.pending++;
+        return true;
+    }
+
+    void ReapAll() {
+        ring.Reap([this](uint64_t user_data, int res) {
+            Complete(reinterpret_cast<Request*>(user_data), res);
+        });
+    }
+
+    void Complete(Request* r, int res) {
+        std::unique_ptr<Request> done(r);
+        ActiveJob& a = *r->active;
+        a.pending--;
+        if (res == -EINTR || res == -EAGAIN)
+            res = 0;
+        else if (res < 0 || (res == 0 && !r->write)) {
+            // A failed request, or a file that shrank under us.
+            if (!a.error)
+                a.error = r->write ? 5 : 1;
+            return;
+        }
+        size_t n = static_cast<size_t>(res);
+        if (n < r->length && !a.error) {
+            // Short transfer: queue the rest. If the queue is full the rest
+            // goes out through the plain system call instead.
+            if (!Queue(a, r->write, r->file_offset + n, r->buf + n, r->length - n, r->fixed))
+                Finish(a, r->write, r->file_offset + n, r->buf + n, r->length - n);
+        }
+    }
+
+    // Completes a transfer with blocking calls.
+    void Finish(ActiveJob& a, bool write, uint64_t offset, uint8_t* buf, size_t length) {
+        while (length > 0) {
+            ssize_t n = write ? pwrite(a.out_fd, buf, length, static_cast<off_t>(offset))
+                              : pread(a.in_fd, buf, length, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                a.error = write ? 5 : 1;
+                return;
+            }
+            buf += n;
+            offset += n;
+            length -= n;
+        }
+    }
+
+    // Moves a job on once its requests have drained. Returns true when it
+    // is finished and released.
+    bool Advance(ActiveJob& a) {
+        if (a.pending > 0)
+            return false;
+        if (!a.error && !a.writing) {
+            if (a.next_read < a.size)
+                return false;
+            a.error = Process(a);
+            a.writing = true;
+        }
+        if (!a.error && a.next_write < a.OutputSize())
+            return false;
+        close(a.in_fd);
+        if (close(a.out_fd) != 0 && !a.error)
+            a.error = 5;
+        slices.Free(a.slice, a.size ? a.size : 1);
+        a.job->result = a.error;
+        return true;
+    }
+
+    // Maps, and if asked encrypts, a fully read file in place.
+    int Process(ActiveJob& a) {
+        size_t size = static_cast<size_t>(a.size);
+        if (!a.job->encrypt) {
+            auto created = OggMap::Create(a.data, size, map_options);
+            if (std::holds_alternative<std::string>(created))
+                return 3;
+            auto& map = std::get<OggMap>(created);
+            a.job->report = map.report;
+            a.header.resize(8 + map.GetLength());
+            store_le32(&a.header[0], 0xA);
+            store_le32(&a.header[4], static_cast<uint32_t>(a.header.size()));
+            map.SerializeTo(&a.header[8], a.header.size() - 8);
+            a.payload = a.data + map.report.data_offset;
+            a.payload_length = size - map.report.data_offset;
+            return 0;
+        }
+        MemoryFile file{ a.data, size, 0 };
+        bool isMogg = size >= 4 && load_le32(a.data) == 0xA;
+        try {
+            std::unique_ptr<VorbisEncrypter> encrypter;
+            if (isMogg)
+                encrypter.reset(new VorbisEncrypter(&file, memoryCallbacks, iv));
+            else
+                encrypter.reset(new VorbisEncrypter(&file, 0x10, memoryCallbacks, map_options, iv));
+            a.job->report = encrypter->GetReport();
+            a.header = encrypter->GetHeader();
+            a.payload = a.data + encrypter->GetSourceOffset();
+            a.payload_length = encrypter->GetLength() - a.header.size();
+            encrypter->EncryptAt(a.payload, static_cast<size_t>(a.payload_length), 0);
+        } catch (const std::runtime_error&) {
+            return 3;
+        }
+        return 0;
+    }
+
+    Uring& ring;
+    uint8_t* arena;
+    size_t arena_size;
+    ArenaSlices slices;
+    bool registered;
+    const OggMapOptions& map_options;
+    const IvOptions& iv;
+    std::list<std::unique_ptr<ActiveJob>> active;
+};
+
+}
+
+bool RunUringBatch(std::vector<BatchJob>& jobs, const OggMapOptions& mapOptions,
+                   const IvOptions& iv, size_t arena_size) {
+    Uring ring;
+    if (!ring.Init(QUEUE_DEPTH))
+        return false;
+    arena_size = (arena_size + 4095) & ~static_cast<size_t>(4095);
+    void* arena = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+        return false;
+    // Without registration the same memory is used through readv/writev.
+    bool registered = ring.RegisterBuffer(arena, arena_size);
+    bool drained;
+    {
+        Batch batch(ring, static_cast<uint8_t*>(arena), arena_size, registered, mapOptions, iv);
+        drained = batch.Run(jobs);
+    }
+    // The ring goes first, so nothing it holds points into a freed arena.
+    // Requests it lost track of keep theirs mapped for good.
+    ring.Close();
+    if (drained)
+        munmap(arena, arena_size);
+    return true;
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "OggMap.h"
+#include "VorbisEncrypter.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MOGG_HAVE_IO_URING 1
+#endif
+#endif
+
+// One file to convert in a batch.
+struct BatchJob {
+	std::string input_path;
+	std::string output_path;
+	bool encrypt = false;
+	// Filled in by the batch: 0 or a makemogg error code, and the scan report.
+	int result = 0;
+	OggMap::ScanReport report{};
+};
+
+// Converts many files on one thread by keeping the reads and writes of
+// several of them in flight together through io_uring. Each admitted file
+// is read whole into a slice of one registered arena, mapped (and
+// encrypted) in memory, then written back out from the same slice.
+//
+// Returns false, without touching any job, if io_uring is unavailable (not
+// Linux, an old kernel, or a sandbox that forbids it); the caller should
+// then convert the jobs one at a time. Jobs too big for the arena, or left
+// over if the ring fails midway, get result -1 for the same treatment.
+bool RunUringBatch(std::vector<BatchJob>& jobs, const OggMapOptions& mapOptions,
+	const IvOptions& iv, size_t arena_size);
@@ -4,104 +4,207 @@
 #include <cstring>
 #include <stdexcept>
 #include <random>
-#include <ctime>
 #include <cstdio>
+#include <cerrno>
+#if defined(__linux__)
+#include <sys/random.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <stdlib.h>
+#define HAVE_ARC4RANDOM 1
+#endif
 #include "keys.h"
+#include "Aes128.h"
 #include "OggMap.h"
+#include "ByteOrder.h"
 
 typedef struct {
     uint32_t a;
     uint32_t b;
 } MapEntry;
 
-// Use a static random engine for IV generation, seeded once
-static std::mt19937 rng(static_cast<unsigned int>(std::time(nullptr)));
-static std::uniform_int_distribution<uint8_t> dist(0, 0xFF);
+// Fills buf from the OS random source. Safe to call from any thread.
+static void FillRandom(uint8_t* buf, size_t len) {
+#if defined(__linux__)
+    while (len > 0) {
+        ssize_t n = getrandom(buf, len, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        buf += n;
+        len -= n;
+    }
+#elif defined(HAVE_ARC4RANDOM)
+    arc4random_buf(buf, len);
+    len = 0;
+#endif
+    if (len > 0) {
+        std::random_device rd;
+        for (size_t i = 0; i < len; i++)
+            buf[i] = static_cast<uint8_t>(rd());
+    }
+}
+
+// splitmix64's finalizer, to spread a 64-bit digest over the IV.
+static uint64_t Mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Fingerprints the pages of an Ogg stream the same way the scanner does,
+// reading only the page headers and the start of BOS pages. Like the
+// scanner it follows the first stream whose BOS page holds a Vorbis
+// identification header, passing over the pages of any other logical
+// stream multiplexed with it, and moves on to the next Vorbis stream of a
+// chain once its EOS page has been seen.
+static uint64_t DigestPages(void* datasource, ov_callbacks cb, size_t offset) {
+    static const uint8_t VORBIS_ID[7] = { 1, 'v', 'o', 'r', 'b', 'i', 's' };
+    uint64_t digest = PAGE_DIGEST_INIT;
+    uint8_t header[PAGE_HEADER_SIZE + 255];
+    bool locked = false, ended = false;
+    uint32_t serial = 0;
+    cb.seek_func(datasource, offset, SEEK_SET);
+    while (cb.read_func(header, 1, PAGE_HEADER_SIZE, datasource) == PAGE_HEADER_SIZE
+        && std::memcmp(header, "OggS", 4) == 0) {
+        uint8_t segments = header[26];
+        if (cb.read_func(header + PAGE_HEADER_SIZE, 1, segments, datasource) != segments)
+            break;
+        uint32_t body = 0;
+        for (int i = 0; i < segments; i++)
+            body += header[PAGE_HEADER_SIZE + i];
+        uint8_t flags = header[5];
+        uint32_t page_serial = load_le32(header + 14);
+        // Another stream's pages, except the BOS page that starts the next
+        // link of a chain once ours has ended
+        bool skip = locked && page_serial != serial && (!(flags & 0x02) || !ended);
+        uint32_t peeked = 0;
+        if (!skip) {
+            digest = page_digest_add(digest, load_le32(header + 22), PAGE_HEADER_SIZE + segments + body);
+            if (locked && page_serial != serial)
+                locked = false;
+            if (!locked && (flags & 0x02) && body >= sizeof(VORBIS_ID)) {
+                uint8_t start[sizeof(VORBIS_ID)];
+                peeked = static_cast<uint32_t>(cb.read_func(start, 1, sizeof(start), datasource));
+                if (peeked == sizeof(start) && std::memcmp(start, VORBIS_ID, sizeof(start)) == 0) {
+                    locked = true;
+                    ended = false;
+                    serial = page_serial;
+                }
+            }
+            if (locked && page_serial == serial && (flags & 0x04))
+                ended = true;
+        }
+        if (cb.seek_func(datasource, body - peeked, SEEK_CUR) != 0)
+            break;
+    }
+    return digest;
+}
 
-void VorbisEncrypter::GenerateIv(uint8_t* header_ptr) {
+void VorbisEncrypter::GenerateIv(uint8_t* header_ptr, const IvOptions& iv, uint64_t page_digest) {
     // For convenience leave the low 4 IV bytes as zero
     for (int i = 0; i < 4; i++) {
         header_ptr[i] = 0;
     }
-    // Generate the remaining 12 IV bytes with random values
-    for (int i = 4; i < 16; i++) {
-        header_ptr[i] = dist(rng);
+    if (iv.mode == IvOptions::RANDOM) {
+        // Generate the remaining 12 IV bytes with random values
+        FillRandom(header_ptr + 4, 12);
+    } else {
+        // Derive them from the seed or the input, with the mode mixed in so
+        // the two never collide. This is a spreading function, not a KDF;
+        // the key is fixed anyway.
+        uint64_t digest = page_digest;
+        if (iv.mode == IvOptions::SEED) {
+            digest = PAGE_DIGEST_INIT;
+            for (uint8_t b : iv.seed) {
+                digest ^= b;
+                digest *= 0x100000001b3ull;
+            }
+        }
+        uint64_t hi = Mix64(digest ^ iv.mode);
+        uint64_t lo = Mix64(hi + 0x9e3779b97f4a7c15ull);
+        for (int i = 0; i < 8; i++)
+            header_ptr[4 + i] = static_cast<uint8_t>(hi >> (i * 8));
+        for (int i = 0; i < 4; i++)
+            header_ptr[12 + i] = static_cast<uint8_t>(lo >> (i * 8));
     }
     initial_counter = reinterpret_cast<aes_ctr_128*>(header_ptr);
 }
 
-VorbisEncrypter::VorbisEncrypter(void* datasource, ov_callbacks cbStruct)
+VorbisEncrypter::VorbisEncrypter(void* datasource, ov_callbacks cbStruct, const IvOptions& iv)
     : file_ref(datasource), cb_struct(cbStruct) {
     cb_struct.seek_func(file_ref, 0, SEEK_END);
     uint32_t total_length = cbStruct.tell_func(file_ref);
     cb_struct.seek_func(file_ref, 0, SEEK_SET);
-    struct {
-        int version;
-        int offset;
-    } original_file_header;
-    if (cbStruct.read_func(&original_file_header, sizeof(original_file_header), 1, file_ref) != 1)
+    // Mogg version and offset, then the OggMap's version, chunk size and
+    // entry count, all little-endian
+    uint8_t original_file_header[8];
+    uint8_t OggMapHdr[12];
+    if (cbStruct.read_func(original_file_header, sizeof(original_file_header), 1, file_ref) != 1)
         throw std::runtime_error("Unable to read mogg header.");
-    if (original_file_header.version != 0xA)
+    if (load_le32(original_file_header) != 0xA)
         throw std::runtime_error("Source mogg must be version 10/0xA (unencrypted).");
 
-    struct {
-        uint32_t version;
-        uint32_t chunk_size;
-        uint32_t num_entries;
-    } OggMapHdr;
-
-    if (cbStruct.read_func(&OggMapHdr, sizeof(OggMapHdr), 1, file_ref) != 1)
+    if (cbStruct.read_func(OggMapHdr, sizeof(OggMapHdr), 1, file_ref) != 1)
         throw std::runtime_error("Unable to read OggMap header.");
+    uint32_t num_entries = load_le32(OggMapHdr + 8);
     size_t header_size = 16 /* IV */
         + sizeof(original_file_header)
         + sizeof(OggMapHdr)
-        + (OggMapHdr.num_entries * sizeof(MapEntry));
+        + (num_entries * sizeof(MapEntry));
     hmx_header.resize(header_size);
 
     auto* header_ptr = hmx_header.data();
-    auto new_header = original_file_header;
-    new_header.version = 0xB;
-    new_header.offset = static_cast<int>(header_size);
-    // Copy Mogg header
-    std::memcpy(header_ptr, &new_header, sizeof(new_header));
-    header_ptr += sizeof(new_header);
+    // Write Mogg header
+    store_le32(header_ptr, 0xB);
+    store_le32(header_ptr + 4, static_cast<uint32_t>(header_size));
+    header_ptr += sizeof(original_file_header);
     // Copy OggMap header
-    std::memcpy(header_ptr, &OggMapHdr, sizeof(OggMapHdr));
+    std::memcpy(header_ptr, OggMapHdr, sizeof(OggMapHdr));
     header_ptr += sizeof(OggMapHdr);
-    // Copy OggMap data
-    cb_struct.read_func(header_ptr, sizeof(MapEntry), OggMapHdr.num_entries, file_ref);
-    header_ptr += sizeof(MapEntry) * OggMapHdr.num_entries;
-    GenerateIv(header_ptr);
-    encrypted_length = total_length - original_file_header.offset + hmx_header.size();
-    source_ogg_offset = original_file_header.offset;
+    // Copy OggMap data; it is already little-endian
+    cb_struct.read_func(header_ptr, sizeof(MapEntry), num_entries, file_ref);
+    header_ptr += sizeof(MapEntry) * num_entries;
+    uint32_t original_offset = load_le32(original_file_header + 4);
+    uint64_t page_digest = 0;
+    if (iv.mode == IvOptions::INPUT_HASH)
+        page_digest = DigestPages(file_ref, cb_struct, original_offset);
+    GenerateIv(header_ptr, iv, page_digest);
+    encrypted_length = total_length - original_offset + hmx_header.size();
+    source_ogg_offset = original_offset;
 }
 
-VorbisEncrypter::VorbisEncrypter(void* datasource, int oggMapType, ov_callbacks cbStruct)
+VorbisEncrypter::VorbisEncrypter(void* datasource, int oggMapType, ov_callbacks cbStruct,
+                                 const OggMapOptions& mapOptions, const IvOptions& iv)
     : file_ref(datasource), cb_struct(cbStruct) {
     cb_struct.seek_func(file_ref, 0, SEEK_END);
     uint32_t total_length = cbStruct.tell_func(file_ref);
     cb_struct.seek_func(file_ref, 0, SEEK_SET);
 
-    auto result = OggMap::Create(datasource, cbStruct);
+    auto result = OggMap::Create(datasource, cbStruct, mapOptions);
     if (std::holds_alternative<std::string>(result)) {
         throw std::runtime_error(std::get<std::string>(result));
     }
     auto& map = std::get<OggMap>(result);
-    auto mapData = map.Serialize();
     // 4 byte version, 4 byte offset, map, 16 byte IV
-    hmx_header.resize(8 + mapData.size() + 16);
-    auto* hdr_as_ints = reinterpret_cast<int32_t*>(hmx_header.data());
-    hdr_as_ints[0] = 0xB;
-    hdr_as_ints[1] = static_cast<int32_t>(hmx_header.size());
-    std::memcpy(&hdr_as_ints[2], mapData.data(), mapData.size());
-    GenerateIv(hmx_header.data() + hmx_header.size() - 16);
-
-    source_ogg_offset = 0;
-    encrypted_length = total_length + hmx_header.size();
+    hmx_header.resize(8 + map.GetLength() + 16);
+    store_le32(hmx_header.data(), 0xB);
+    store_le32(hmx_header.data() + 4, static_cast<uint32_t>(hmx_header.size()));
+    map.SerializeTo(hmx_header.data() + 8, map.GetLength());
+    GenerateIv(hmx_header.data() + hmx_header.size() - 16, iv, map.report.page_digest);
+
+    report = map.report;
+    if (mapOptions.prefetch)
+        prefetch = map.SerializePrefetch(static_cast<uint32_t>(hmx_header.size()));
+    // Junk skipped by resync before the first page is left out
+    source_ogg_offset = map.report.data_offset;
+    encrypted_length = total_length - source_ogg_offset + hmx_header.size();
 }
 
 VorbisEncrypter::~VorbisEncrypter() {
-    cb_struct.close_func(file_ref);
+    if (cb_struct.close_func)
+        cb_struct.close_func(file_ref);
 }
 
 size_t VorbisEncrypter::ReadRaw(void* buf, size_t elementSize, size_t elements)
@@ -124,62 +227,66 @@ size_t VorbisEncrypter::ReadRaw(void* buf, size_t elementSize, size_t elements)
     }
     if (count == 0) return 0;
 
-    int32_t size_diff = static_cast<int32_t>(source_ogg_offset) - static_cast<int32_t>(hmx_header.size());
-    cb_struct.seek_func(file_ref, position + size_diff, SEEK_SET);
-    size_t actualRead = cb_struct.read_func(buffer + offset, 1, count, file_ref);
+    size_t payloadPos = position - hmx_header.size();
+    size_t actualRead = ReadPayload(buffer + offset, count, payloadPos);
 
     bytesRead += actualRead;
     position += actualRead;
 
-    EncryptBytes(buffer, offset, actualRead);
+    EncryptAt(buffer + offset, actualRead, payloadPos);
     return bytesRead / elementSize;
 }
 
-// Fixes the counter
-void VorbisEncrypter::FixCounter(size_t decryptedPos) {
-    counter = *initial_counter;
-    uint64_t low = counter.qwords[0];
-    counter.qwords[0] += (decryptedPos >> 4);
-    if (counter.qwords[0] < low) {
-        counter.qwords[1]++;
-    }
+size_t VorbisEncrypter::ReadPayload(void* buf, size_t count, uint64_t payloadPos)
+{
+    if (cb_struct.seek_func(file_ref, source_ogg_offset + payloadPos, SEEK_SET) != 0)
+        return 0;
+    return cb_struct.read_func(buf, 1, count, file_ref);
 }
 
-// Increments a 128-bit counter using 64-bit word size
-inline void IncrementCounter(aes_ctr_128* ctr) {
-    for (int ptr = 0; ptr < 2; ptr++) {
-        ctr->qwords[ptr]++;
-        if (ctr->qwords[ptr] != 0)
-            break;
-    }
-}
+// CTR mode: byte n of the payload is XORed with byte n % 16 of the
+// encrypted counter IV + n / 16, added as a 128-bit number in host words.
+// ctrKey0B's round keys, expanded by the compiler.
+static constexpr aes128_key ctrKey0BSchedule = aes128_expand_key(ctrKey0B);
 
-/**
- * buffer: buffer to write into
- * offset: offset into buffer to start writing
- * count: number of bytes to write into buffer
- *
- * This relies on the internal state, specifically that oggPos is set to the
- * last READ location. So if oggPos is 30 and count is 10 it assumes that bytes from 20 to 30 are being decrypted.
- */
-void VorbisEncrypter::EncryptBytes(uint8_t* buffer, size_t offset, size_t count)
+void CtrCrypt(const uint8_t* iv, uint8_t* buf, size_t count, uint64_t payloadPos)
 {
-    aes_ctr_128 cryptedCounter;
-    size_t decryptedPos = position - count - hmx_header.size();
-    int counterLoc = static_cast<int>(decryptedPos % 16);
-
-    FixCounter(decryptedPos);
-    AES128_ECB_encrypt(counter.bytes, ctrKey0B, cryptedCounter.bytes);
-    for (size_t i = 0; i < count; i++)
+    // Counters are generated and encrypted a batch at a time, so the cipher
+    // sees many independent blocks per call.
+    const size_t BATCH = 64;
+    aes_ctr_128 initial;
+    std::memcpy(initial.bytes, iv, sizeof(initial.bytes));
+    aes_ctr_128 counters[BATCH];
+    size_t i = 0;
+    while (i < count)
     {
-        if (decryptedPos != 0 && decryptedPos % 16 == 0 && i != 0)
-        {
-            FixCounter(decryptedPos);
-            counterLoc = 0;
-            AES128_ECB_encrypt(counter.bytes, ctrKey0B, cryptedCounter.bytes);
+        uint64_t pos = payloadPos + i;
+        size_t counterLoc = static_cast<size_t>(pos & 15);
+        size_t blocks = (counterLoc + (count - i) + 15) / 16;
+        if (blocks > BATCH)
+            blocks = BATCH;
+        for (size_t b = 0; b < blocks; b++) {
+            aes_ctr_128& counter = counters[b];
+            counter = initial;
+            uint64_t low = counter.qwords[0];
+            counter.qwords[0] += (pos >> 4) + b;
+            if (counter.qwords[0] < low) {
+                counter.qwords[1]++;
+            }
         }
-        buffer[i + offset] ^= cryptedCounter.bytes[counterLoc]; //decrypt one byte
-        decryptedPos++;
-        counterLoc++;
+        uint8_t* keystream = reinterpret_cast<uint8_t*>(counters);
+        aes128_encrypt_blocks(ctrKey0BSchedule, keystream, keystream, blocks);
+        keystream += counterLoc;
+        size_t n = blocks * 16 - counterLoc;
+        if (n > count - i)
+            n = count - i;
+        for (size_t k = 0; k < n; k++)
+            buf[i + k] ^= keystream[k];
+        i += n;
     }
-}
\ No newline at end of file
+}
+
+void VorbisEncrypter::EncryptAt(uint8_t* buf, size_t count, uint64_t payloadPos) const
+{
+    CtrCrypt(initial_counter->bytes, buf, count, payloadPos);
+}
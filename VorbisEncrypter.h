@@ -3,28 +3,64 @@
 #ifndef _OV_FILE_H_
 #include "XiphTypes.h"
 #endif
-#include "aes.h"
+#include "Aes128.h"
+#include "OggMap.h"
 
 #include <inttypes.h>
 #include <vector>
 
+// Where an encrypter gets the 12 varying bytes of its IV.
+struct IvOptions {
+	enum Mode {
+		// Fresh bytes from the OS random source.
+		RANDOM,
+		// Derived from `seed`: the same seed gives the same IV.
+		SEED,
+		// Derived from a fingerprint of the source's Ogg pages, so identical
+		// audio always encrypts to byte-identical output.
+		INPUT_HASH,
+	} mode = RANDOM;
+	std::vector<uint8_t> seed;
+};
+
+// Encrypts or, as it is the same operation, decrypts `count` bytes of an
+// 0xB payload in place, given the 16-byte IV from the end of its header
+// and where the bytes sit in the payload.
+void CtrCrypt(const uint8_t* iv, uint8_t* buf, size_t count, uint64_t payloadPos);
+
 class VorbisEncrypter
 {
 public:
 	// Construct an encrypter using the given unencrypted file as a source.
-	VorbisEncrypter(void* datasource, ov_callbacks cbStruct);
+	VorbisEncrypter(void* datasource, ov_callbacks cbStruct, const IvOptions& iv = IvOptions());
 	// Construct an encrypter using the given plain ogg vorbis file as a source.
-	VorbisEncrypter(void* datasource, int oggMapType, ov_callbacks cbStruct);
+	VorbisEncrypter(void* datasource, int oggMapType, ov_callbacks cbStruct,
+		const OggMapOptions& mapOptions = OggMapOptions(), const IvOptions& iv = IvOptions());
 	~VorbisEncrypter();
 
 	// Read encrypted Mogg data. Returns number of elements read.
 	size_t ReadRaw(void* buf, size_t elementSize, size_t elements);
+	// Total size in bytes of the encrypted mogg, header included.
+	size_t GetLength() const { return encrypted_length; }
+	// The mogg header, IV included, that comes before the payload.
+	const std::vector<uint8_t>& GetHeader() const { return hmx_header; }
+	// Where the Ogg data that becomes the payload starts in the source.
+	size_t GetSourceOffset() const { return source_ogg_offset; }
+	// Reads up to `count` bytes of the source's Ogg data from `payloadPos`
+	// bytes into it, unencrypted. Returns the number of bytes read.
+	size_t ReadPayload(void* buf, size_t count, uint64_t payloadPos);
+	// Encrypts, in place, `count` bytes that sit `payloadPos` bytes into the
+	// payload. Only the IV is used, so blocks can be done in any order and
+	// from any one thread at a time.
+	void EncryptAt(uint8_t* buf, size_t count, uint64_t payloadPos) const;
+	// What the map scan found, when constructed from a plain ogg.
+	const OggMap::ScanReport& GetReport() const { return report; }
+	// The serialized prefetch table for the output, when constructed from a
+	// plain ogg with mapOptions.prefetch set; otherwise empty.
+	const std::vector<uint8_t>& GetPrefetch() const { return prefetch; }
 private:
-	void GenerateIv(uint8_t* header_ptr);
-
+	void GenerateIv(uint8_t* header_ptr, const IvOptions& iv, uint64_t page_digest);
 
-	void FixCounter(size_t decryptedPos);
-	void EncryptBytes(uint8_t* buffer, size_t offset, size_t count);
 
 	ov_callbacks cb_struct{};
 	void* file_ref{ 0 };
@@ -34,6 +70,7 @@ private:
 	std::vector<uint8_t> hmx_header;
 
 	size_t source_ogg_offset{ 0 };
+	OggMap::ScanReport report{};
+	std::vector<uint8_t> prefetch;
 	aes_ctr_128* initial_counter{ 0 };
-	aes_ctr_128 counter{ 0 };
 };
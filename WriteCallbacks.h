@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdio.h>
+#ifndef _OV_FILE_H_
+#include "XiphTypes.h"
+#endif
+
+// The output counterpart of ov_callbacks. write_func returns the number of
+// elements written, like fwrite. seek_func and tell_func behave like fseek
+// and ftell; sequential conversions never call them, so they may be NULL
+// for sinks that can't seek, such as sockets or pipes.
+typedef struct {
+	size_t(*write_func) (const void *ptr, size_t size, size_t nmemb, void *sink);
+	int(*seek_func)  (void *sink, ogg_int64_t offset, int whence);
+	long(*tell_func)  (void *sink);
+} mogg_write_callbacks;
@@ -0,0 +1,96 @@
+// Reports header size and average seek overshoot for several OggMap
+// densities. Overshoot is what a player has to decode and throw away after
+// seeking: the samples between the map entry it starts from and the target,
+// and the bytes between the entry's offset and the packet holding the target.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <variant>
+#include <vector>
+
+#include "OggMap.h"
+#include "oggvorbis.h"
+#include "OggSource.h"
+#include "synth_ogg.h"
+
+struct PacketPos {
+    size_t bytes;
+    int64_t end_sample;
+};
+
+struct Setting {
+    const char* name;
+    OggMapOptions options;
+};
+
+static Setting MakeSetting(const char* name, uint32_t chunk, uint32_t increment, bool exact) {
+    Setting s{ name, OggMapOptions() };
+    s.options.chunk_size = chunk;
+    s.options.seek_increment = increment;
+    s.options.exact_pages = exact;
+    return s;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 240;
+    auto ogg = synth::Generate(seconds, 1);
+
+    // Where every packet starts and which sample it decodes up to.
+    std::vector<PacketPos> packets;
+    MemorySource file(ogg.data(), ogg.size());
+    vorbis_state* vs;
+    if (vorbis_init(file, &vs) != OK) {
+        fprintf(stderr, "Could not scan the synthetic stream\n");
+        return 1;
+    }
+    while (vorbis_next(vs, file) == OK)
+        packets.push_back({ vs->cur_packet_start - vs->data_offset, vs->next_sample });
+    vorbis_free(vs);
+    int64_t total = packets.back().end_sample;
+
+    const Setting settings[] = {
+        MakeSetting("default 20000 / 32K", 20000, 0x8000, false),
+        MakeSetting("20000 / 8K", 20000, 0x2000, false),
+        MakeSetting("20000 / exact", 20000, 0, true),
+        MakeSetting("5000 / 8K", 5000, 0x2000, false),
+        MakeSetting("5000 / exact", 5000, 0, true),
+        MakeSetting("2000 / exact", 2000, 0, true),
+        MakeSetting("1000 / exact", 1000, 0, true),
+    };
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> target_dist(0, total - 1);
+    std::vector<int64_t> targets(100000);
+    for (auto& t : targets)
+        t = target_dist(rng);
+
+    printf("%.0f s synthetic stream, %zu bytes, %zu packets\n\n", seconds, ogg.size(), packets.size());
+    printf("%-22s %10s %10s %14s %14s %12s\n",
+        "chunk / seek points", "entries", "header", "avg samples", "max samples", "avg bytes");
+    for (const auto& setting : settings) {
+        auto result = OggMap::Create(ogg.data(), ogg.size(), setting.options);
+        if (std::holds_alternative<std::string>(result)) {
+            fprintf(stderr, "%s: %s\n", setting.name, std::get<std::string>(result).c_str());
+            return 1;
+        }
+        auto& map = std::get<OggMap>(result);
+
+        double sum_samples = 0, sum_bytes = 0;
+        int64_t max_samples = 0;
+        for (int64_t t : targets) {
+            auto entry = map.Lookup(t);
+            auto hit = std::lower_bound(packets.begin(), packets.end(), t,
+                [](const PacketPos& p, int64_t s) { return p.end_sample < s; });
+            int64_t samples = t - entry.samples;
+            sum_samples += samples;
+            sum_bytes += static_cast<double>(hit->bytes) - entry.bytes;
+            max_samples = std::max(max_samples, samples);
+        }
+        printf("%-22s %10u %10zu %14.0f %14lld %12.0f\n", setting.name, map.num_entries,
+            8 + map.GetLength(), sum_samples / targets.size(), static_cast<long long>(max_samples),
+            sum_bytes / targets.size());
+    }
+    return 0;
+}
@@ -0,0 +1,296 @@
+// Whole-file conversion throughput at 1..N threads, over a synthetic corpus
+// shaped like a real library: a few large multitrack songs, a batch of
+// ordinary stereo songs and many tiny stems. Each thread converts whole
+// files, unencrypted and then encrypted, with the inputs in the page cache
+// (hot) and evicted from it before the run (cold, where the OS lets us).
+//
+//   bench/scale [max_threads] [corpus_scale]
+//
+// Prints JSON: per run, files/s, MB/s of input, p50/p99 per-file latency,
+// peak RSS, and efficiency, the speedup over one thread divided by the
+// thread count. "flags" points out where scaling stops short. A mode that
+// scales much worse than the other at the same thread count suggests state
+// shared between conversions on its path, as the AES code and IV rng once
+// were for encryption.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "makemogg_lib.h"
+#include "synth_ogg.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct FileClass {
+    const char* name;
+    int count;
+    double seconds;
+    int channels;
+    size_t min_packet;
+    size_t max_packet;
+};
+
+// Multitrack songs carry many channels, so much bigger packets.
+static const FileClass CLASSES[] = {
+    { "multitrack", 3, 300, 12, 1500, 6000 },
+    { "song", 24, 200, 2, 100, 700 },
+    { "stem", 300, 4, 1, 20, 300 },
+};
+
+struct CorpusFile {
+    std::string path;
+    uint64_t size;
+};
+
+struct Run {
+    const char* mode;
+    const char* cache;
+    int threads;
+    double seconds;
+    double files_per_s;
+    double mb_per_s;
+    double p50_ms;
+    double p99_ms;
+    double peak_rss_mb;
+    double efficiency;
+};
+
+// Evicts a file from the page cache. Returns false where that isn't
+// possible.
+static bool DropFromCache(const std::string& path) {
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    fdatasync(fd);
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// Resets the peak RSS counter on Linux, so each run reports its own peak;
+// elsewhere the peak is the process's so far.
+static void ResetPeakRss() {
+#if defined(__linux__)
+    if (FILE* f = fopen("/proc/self/clear_refs", "w")) {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+static double PeakRssMb() {
+#if defined(__linux__)
+    if (FILE* f = fopen("/proc/self/status", "r")) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+                break;
+        }
+        fclose(f);
+        if (kb >= 0)
+            return kb / 1024.0;
+    }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t i = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[i];
+}
+
+static Run Convert(const std::vector<CorpusFile>& corpus, bool encrypt, bool cold, int threads) {
+    for (size_t i = 0; i < corpus.size(); i++) {
+        std::string out = "bench/scale_corpus/out" + std::to_string(i) + ".mogg";
+        remove(out.c_str());
+        if (cold)
+            DropFromCache(corpus[i].path);
+    }
+    makemogg_options opts;
+    makemogg_options_init(&opts);
+    // Threads convert separate files, so each file runs single-threaded
+    opts.pipeline = 0;
+
+    std::vector<double> latency(corpus.size());
+    std::atomic<size_t> next{ 0 };
+    std::atomic<bool> failed{ false };
+    auto worker = [&] {
+        for (size_t i; (i = next++) < corpus.size();) {
+            std::string out = "bench/scale_corpus/out" + std::to_string(i) + ".mogg";
+            Clock::time_point start = Clock::now();
+            int rc = encrypt
+                ? makemogg_create_encrypted(corpus[i].path.c_str(), out.c_str(), &opts, nullptr)
+                : makemogg_create_unencrypted_ex(corpus[i].path.c_str(), out.c_str(), &opts, nullptr);
+            latency[i] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (rc != 0)
+                failed = true;
+        }
+    };
+
+    ResetPeakRss();
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.emplace_back(worker);
+    for (std::thread& t : pool)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (failed) {
+        fprintf(stderr, "Conversion failed\n");
+        exit(1);
+    }
+
+    uint64_t bytes = 0;
+    for (const CorpusFile& f : corpus)
+        bytes += f.size;
+    Run run{};
+    run.mode = encrypt ? "encrypted" : "unencrypted";
+    run.cache = cold ? "cold" : "hot";
+    run.threads = threads;
+    run.seconds = seconds;
+    run.files_per_s = corpus.size() / seconds;
+    run.mb_per_s = bytes / seconds / 1e6;
+    run.p50_ms = Percentile(latency, 0.5);
+    run.p99_ms = Percentile(latency, 0.99);
+    run.peak_rss_mb = PeakRssMb();
+    return run;
+}
+
+int main(int argc, char** argv) {
+    int cpus = static_cast<int>(std::thread::hardware_concurrency());
+    int max_threads = argc > 1 ? atoi(argv[1]) : std::max(cpus, 1);
+    double scale = argc > 2 ? atof(argv[2]) : 1;
+
+    // Generate the corpus one file at a time, so it never sits in memory
+    std::filesystem::create_directories("bench/scale_corpus");
+    std::vector<CorpusFile> corpus;
+    std::string classes;
+    uint32_t seed = 1;
+    for (const FileClass& c : CLASSES) {
+        int count = std::max(1, static_cast<int>(c.count * scale));
+        uint64_t class_bytes = 0;
+        for (int i = 0; i < count; i++) {
+            auto ogg = synth::Generate(c.seconds, seed++, 44100, c.channels, c.min_packet, c.max_packet);
+            std::string path = "bench/scale_corpus/" + std::string(c.name) + std::to_string(i) + ".ogg";
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size()) {
+                fprintf(stderr, "Could not write %s\n", path.c_str());
+                return 1;
+            }
+            fclose(f);
+            corpus.push_back({ path, ogg.size() });
+            class_bytes += ogg.size();
+        }
+        char entry[160];
+        snprintf(entry, sizeof(entry), "%s{\"name\": \"%s\", \"files\": %d, \"bytes\": %llu}",
+                 classes.empty() ? "" : ", ", c.name, count, static_cast<unsigned long long>(class_bytes));
+        classes += entry;
+    }
+    // Convert largest first, so one big file doesn't finish a run alone
+    std::sort(corpus.begin(), corpus.end(), [](const CorpusFile& a, const CorpusFile& b) { return a.size > b.size; });
+    uint64_t total = 0;
+    for (const CorpusFile& f : corpus)
+        total += f.size;
+
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+    bool can_evict = DropFromCache(corpus[0].path);
+
+    std::vector<Run> runs;
+    std::vector<std::string> flags;
+    for (bool encrypt : { false, true }) {
+        for (bool cold : { false, true }) {
+            if (cold && !can_evict)
+                continue;
+            // One untimed pass warms the cache and the allocator
+            if (!cold)
+                Convert(corpus, encrypt, false, 1);
+            double base = 0;
+            for (int threads : thread_counts) {
+                fprintf(stderr, "%s %s, %d threads\n", encrypt ? "encrypted" : "unencrypted",
+                        cold ? "cold" : "hot", threads);
+                Run run = Convert(corpus, encrypt, cold, threads);
+                if (threads == 1)
+                    base = run.mb_per_s;
+                run.efficiency = base > 0 ? run.mb_per_s / (base * threads) : 0;
+                runs.push_back(run);
+                if (threads > 1 && threads <= cpus && run.efficiency < 0.6) {
+                    char flag[200];
+                    snprintf(flag, sizeof(flag), "%s %s: %d threads reach %.0f%% of linear scaling",
+                             run.mode, run.cache, threads, run.efficiency * 100);
+                    flags.push_back(flag);
+                }
+            }
+        }
+    }
+    // The modes differ only in the encryption path
+    for (const Run& e : runs) {
+        for (const Run& u : runs) {
+            if (strcmp(e.mode, "encrypted") == 0 && strcmp(u.mode, "unencrypted") == 0
+                && strcmp(e.cache, u.cache) == 0 && e.threads == u.threads && e.threads > 1
+                && e.efficiency < 0.75 * u.efficiency) {
+                char flag[240];
+                snprintf(flag, sizeof(flag),
+                         "encrypted %s scales worse than unencrypted at %d threads (%.2f vs %.2f): "
+                         "look for state shared between conversions on the encryption path",
+                         e.cache, e.threads, e.efficiency, u.efficiency);
+                flags.push_back(flag);
+            }
+        }
+    }
+
+    printf("{\n  \"cpus\": %d,\n", cpus);
+    printf("  \"corpus\": {\"files\": %zu, \"bytes\": %llu, \"classes\": [%s]},\n", corpus.size(),
+           static_cast<unsigned long long>(total), classes.c_str());
+    printf("  \"runs\": [\n");
+    for (size_t i = 0; i < runs.size(); i++) {
+        const Run& r = runs[i];
+        printf("    {\"mode\": \"%s\", \"cache\": \"%s\", \"threads\": %d, \"seconds\": %.3f, "
+               "\"files_per_s\": %.1f, \"mb_per_s\": %.1f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+               "\"peak_rss_mb\": %.1f, \"efficiency\": %.2f}%s\n",
+               r.mode, r.cache, r.threads, r.seconds, r.files_per_s, r.mb_per_s, r.p50_ms, r.p99_ms,
+               r.peak_rss_mb, r.efficiency, i + 1 < runs.size() ? "," : "");
+    }
+    printf("  ],\n  \"flags\": [");
+    for (size_t i = 0; i < flags.size(); i++)
+        printf("%s\n    \"%s\"", i ? "," : "", flags[i].c_str());
+    printf("%s]\n}\n", flags.empty() ? "" : "\n  ");
+
+    std::filesystem::remove_all("bench/scale_corpus");
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Times building an OggMap from the same stream through each input: the
+// ov_callbacks path, which goes through a function pointer for every read,
+// and the sources the scanner is instantiated on directly.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "OggMap.h"
+#include "OggSource.h"
+#include "synth_ogg.h"
+
+struct MemoryFile {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+};
+
+static ov_callbacks memoryCallbacks = {
+    [](void* ptr, size_t size, size_t nmemb, void* datasource) -> size_t {
+        auto* f = static_cast<MemoryFile*>(datasource);
+        size_t n = std::min(size * nmemb, f->size - f->pos) / size;
+        memcpy(ptr, f->data + f->pos, n * size);
+        f->pos += n * size;
+        return n;
+    },
+    [](void* datasource, ogg_int64_t offset, int whence) -> int {
+        auto* f = static_cast<MemoryFile*>(datasource);
+        ogg_int64_t base = whence == SEEK_CUR ? f->pos : whence == SEEK_END ? f->size : 0;
+        if (base + offset < 0 || base + offset > static_cast<ogg_int64_t>(f->size))
+            return -1;
+        f->pos = static_cast<size_t>(base + offset);
+        return 0;
+    },
+    [](void*) -> int { return 0; },
+    [](void* datasource) -> long { return static_cast<long>(static_cast<MemoryFile*>(datasource)->pos); },
+};
+
+typedef std::variant<std::string, OggMap> Result;
+
+// Best of several runs, in MB/s of input.
+static double Measure(const char* name, size_t bytes, const std::function<Result()>& scan) {
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        Result result = scan();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (std::holds_alternative<std::string>(result)) {
+            fprintf(stderr, "%s: %s\n", name, std::get<std::string>(result).c_str());
+            exit(1);
+        }
+        best = std::max(best, bytes / elapsed.count() / 1e6);
+    }
+    printf("%-28s %10.0f MB/s\n", name, best);
+    return best;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1200;
+    auto ogg = synth::Generate(seconds, 1);
+    printf("%.0f s synthetic stream, %zu bytes\n\n", seconds, ogg.size());
+
+    Measure("ov_callbacks (memory)", ogg.size(), [&] {
+        MemoryFile file{ ogg.data(), ogg.size(), 0 };
+        return OggMap::Create(&file, memoryCallbacks);
+    });
+    Measure("MemorySource", ogg.size(), [&] {
+        return OggMap::Create(ogg.data(), ogg.size());
+    });
+
+#if defined(MOGG_HAVE_MMAP)
+    // The file sources read from the page cache once warmed up.
+    const char* path = "bench/scan_sources.tmp";
+    FILE* f = fopen(path, "wb");
+    if (!f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size()) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return 1;
+    }
+    fclose(f);
+    Measure("ov_callbacks (FILE*)", ogg.size(), [&] {
+        FILE* in = fopen(path, "rb");
+        ov_callbacks cb = { [](void* p, size_t s, size_t n, void* d) { return fread(p, s, n, (FILE*)d); },
+            [](void* d, ogg_int64_t o, int w) { return fseek((FILE*)d, o, w); },
+            [](void* d) { return fclose((FILE*)d); },
+            [](void* d) { return ftell((FILE*)d); } };
+        Result result = OggMap::Create(in, cb);
+        fclose(in);
+        return result;
+    });
+    Measure("FdSource", ogg.size(), [&] {
+        FdDatasource* fd = fd_datasource_open(path);
+        FdSource source(fd);
+        Result result = OggMap::CreateFrom(source);
+        fdCallbacks.close_func(fd);
+        return result;
+    });
+    Measure("MmapSource", ogg.size(), [&] {
+        MmapSource source(path);
+        return OggMap::CreateFrom(static_cast<MemorySource&>(source));
+    });
+    remove(path);
+#endif
+    return 0;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// Generates synthetic Ogg Vorbis streams for benchmarks. The headers are
+// valid for the scanner in oggvorbis.cpp and the audio packets carry real
+// mode bits, block sizes and granule positions, but random payloads, so
+// they can't be decoded to sound. Nothing but this library needs to read
+// them.
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "oggcrc.h"
+
+namespace synth {
+
+class BitWriter {
+public:
+    void Write(uint64_t value, int bits) {
+        for (int i = 0; i < bits; i++) {
+            if (count % 8 == 0)
+                bytes.push_back(0);
+            if ((value >> i) & 1)
+                bytes.back() |= 1 << (count % 8);
+            count++;
+        }
+    }
+    std::vector<uint8_t> bytes;
+private:
+    size_t count = 0;
+};
+
+inline void WriteMagic(BitWriter& w, int type) {
+    w.Write(type, 8);
+    for (const char* c = "vorbis"; *c; c++)
+        w.Write(static_cast<uint8_t>(*c), 8);
+}
+
+inline std::vector<uint8_t> IdHeader(int channels, uint32_t rate) {
+    BitWriter w;
+    WriteMagic(w, 1);
+    w.Write(0, 32);
+    w.Write(channels, 8);
+    w.Write(rate, 32);
+    w.Write(0, 32);
+    w.Write(128000, 32);
+    w.Write(0, 32);
+    w.Write(8, 4);  // blocksize_0 = 256
+    w.Write(11, 4); // blocksize_1 = 2048
+    w.Write(1, 1);
+    return w.bytes;
+}
+
+inline std::vector<uint8_t> CommentHeader() {
+    BitWriter w;
+    WriteMagic(w, 3);
+    const char vendor[] = "synth";
+    w.Write(sizeof(vendor) - 1, 32);
+    for (const char* c = vendor; *c; c++)
+        w.Write(static_cast<uint8_t>(*c), 8);
+    w.Write(0, 32);
+    w.Write(1, 1);
+    return w.bytes;
+}
+
+// One codebook, one type 1 floor, one residue, one mapping, and two modes
+// (short and long blocks).
+inline std::vector<uint8_t> SetupHeader() {
+    BitWriter w;
+    WriteMagic(w, 5);
+    w.Write(0, 8);
+    w.Write(0x564342, 24); w.Write(1, 16); w.Write(2, 24);
+    w.Write(0, 1); w.Write(0, 1); w.Write(0, 5); w.Write(0, 5); w.Write(0, 4);
+    w.Write(0, 6); w.Write(0, 16);
+    w.Write(0, 6); w.Write(1, 16); w.Write(0, 5); w.Write(0, 2); w.Write(4, 4);
+    w.Write(0, 6); w.Write(0, 16); w.Write(0, 24); w.Write(100, 24); w.Write(15, 24);
+    w.Write(0, 6); w.Write(0, 8); w.Write(0, 3); w.Write(0, 1);
+    w.Write(0, 6); w.Write(0, 16); w.Write(0, 1); w.Write(0, 1); w.Write(0, 2);
+    w.Write(0, 8); w.Write(0, 8); w.Write(0, 8);
+    w.Write(1, 6);
+    for (int blockflag = 0; blockflag < 2; blockflag++) {
+        w.Write(blockflag, 1); w.Write(0, 16); w.Write(0, 16); w.Write(0, 8);
+    }
+    w.Write(1, 1);
+    return w.bytes;
+}
+
+class PageWriter {
+public:
+    PageWriter(std::vector<uint8_t>& out, uint32_t serial) : out(out), serial(serial) {}
+
+    // Adds a packet, flushing first if the page would get too big.
+    void Packet(const std::vector<uint8_t>& packet, int64_t end_granule) {
+        size_t lacing = packet.size() / 255 + 1;
+        if (segments.size() + lacing > 255 || body.size() > 4000)
+            Flush(0);
+        for (size_t n = packet.size(); ; n -= 255) {
+            segments.push_back(static_cast<uint8_t>(n >= 255 ? 255 : n));
+            if (n < 255)
+                break;
+        }
+        body.insert(body.end(), packet.begin(), packet.end());
+        granule = end_granule;
+    }
+
+    void Flush(uint8_t flags) {
+        size_t start = out.size();
+        uint8_t header[27] = { 'O', 'g', 'g', 'S', 0, flags };
+        memcpy(header + 6, &granule, 8);
+        memcpy(header + 14, &serial, 4);
+        memcpy(header + 18, &sequence, 4);
+        header[26] = static_cast<uint8_t>(segments.size());
+        out.insert(out.end(), header, header + 27);
+        out.insert(out.end(), segments.begin(), segments.end());
+        out.insert(out.end(), body.begin(), body.end());
+        uint32_t crc = ogg_page_crc(out.data() + start, out.size() - start);
+        memcpy(out.data() + start + 22, &crc, 4);
+        segments.clear();
+        body.clear();
+        sequence++;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint32_t serial;
+    uint32_t sequence = 0;
+    int64_t granule = 0;
+    std::vector<uint8_t> segments;
+    std::vector<uint8_t> body;
+};
+
+// Packet sizes are drawn from [min_packet, max_packet]; about 30% of the
+// blocks are long ones, as in typical music.
+inline std::vector<uint8_t> Generate(double seconds, uint32_t seed, uint32_t rate = 44100,
+                                     int channels = 2, size_t min_packet = 20, size_t max_packet = 600) {
+    std::vector<uint8_t> out;
+    std::mt19937 rng(seed);
+    PageWriter pages(out, seed);
+    pages.Packet(IdHeader(channels, rate), 0);
+    pages.Flush(2);
+    pages.Packet(CommentHeader(), 0);
+    pages.Packet(SetupHeader(), 0);
+    pages.Flush(0);
+
+    std::uniform_int_distribution<size_t> size(min_packet, max_packet);
+    std::uniform_int_distribution<int> byte(0, 255);
+    int64_t total = static_cast<int64_t>(seconds * rate);
+    int64_t samples = 0;
+    uint32_t last_bs = 0;
+    std::vector<uint8_t> packet;
+    while (samples < total) {
+        bool long_block = rng() % 10 < 3;
+        uint32_t bs = long_block ? 2048 : 256;
+        if (last_bs)
+            samples += (last_bs + bs) / 4;
+        last_bs = bs;
+        packet.resize(size(rng));
+        for (auto& b : packet)
+            b = static_cast<uint8_t>(byte(rng));
+        packet[0] = static_cast<uint8_t>((packet[0] & ~3) | (long_block << 1));
+        pages.Packet(packet, samples);
+    }
+    pages.Flush(4);
+    return out;
+}
+
+}
@@ -0,0 +1,323 @@
+// Command line front end to the library.
+//
+//   makemogg [options] <input> <output>
+//   makemogg [options] <input>... -o <dir>
+//   makemogg [options] -m <manifest> [-o <dir>]
+//
+// The first form converts one file, as the tool always has; it is used for
+// two arguments naming files, without -o or -m, unless the second is an
+// existing .ogg, as when a shell pattern matched two inputs: those are
+// converted side by side instead of one overwriting the other. Otherwise
+// each input may be a file, a directory (searched recursively for .ogg
+// files, whose layout is mirrored under the output directory) or a quoted
+// pattern with * and ? in its last component. A manifest lists one job per
+// line, "<input>" or "<input><TAB><output>", with paths relative to the
+// current directory; blank lines and lines starting with # are skipped.
+// Outputs are named after their inputs with a .mogg extension, in the -o
+// directory or else beside the input.
+//
+// Options:
+//   -e        make encrypted (0xB) moggs
+//   -j N      convert N files at once (default: one per core)
+//   -f        convert even if the output is newer than the input
+//   -r        resync past damaged pages and leading junk
+//   -c        check the CRC of every page
+//   -q        only print failures and the summary
+//
+// Except in the first form, an output at least as new as its input is
+// skipped, if it is the kind of mogg (0xA or 0xB) being made. Each file is
+// written to <output>.part and renamed into place once complete, so an
+// interrupted run never leaves a truncated output that looks up to date.
+// Exits 1 if any file failed, 2 on bad usage.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "makemogg_lib.h"
+
+namespace fs = std::filesystem;
+
+struct Job {
+    fs::path input;
+    fs::path output;
+};
+
+struct Options {
+    bool encrypt = false;
+    bool force = false;
+    bool quiet = false;
+    int threads = 0;
+    makemogg_options convert;
+};
+
+static void Usage() {
+    fprintf(stderr,
+            "usage: makemogg [options] <input> <output>\n"
+            "       makemogg [options] <input>... -o <dir>\n"
+            "       makemogg [options] -m <manifest> [-o <dir>]\n"
+            "options: -e encrypt, -j N threads, -f force, -r resync, -c check CRCs, -q quiet\n");
+    exit(2);
+}
+
+static const char* Describe(int rc) {
+    switch (rc) {
+        case 1: return "could not open the input";
+        case 2: return "could not open the output";
+        case 3: return "could not read or map the input";
+        case 4: return "invalid options";
+        case 5: return "could not write the output";
+        case 6: return "cancelled";
+        default: return "failed";
+    }
+}
+
+static bool HasOggExtension(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".ogg";
+}
+
+// Matches * and ? wildcards against a whole file name.
+static bool Matches(const char* pattern, const char* name) {
+    for (; *pattern; pattern++, name++) {
+        if (*pattern == '*') {
+            for (const char* rest = name;; rest++) {
+                if (Matches(pattern + 1, rest))
+                    return true;
+                if (!*rest)
+                    return false;
+            }
+        }
+        if (!*name || (*pattern != '?' && *pattern != *name))
+            return false;
+    }
+    return !*name;
+}
+
+static fs::path OutputFor(const fs::path& input, const fs::path& relative, const fs::path& out_dir) {
+    fs::path name = relative;
+    name.replace_extension(".mogg");
+    if (out_dir.empty())
+        return input.parent_path() / name.filename();
+    return out_dir / name;
+}
+
+// Expands one input argument into jobs. Returns false if it names nothing.
+static bool AddInput(const std::string& arg, const fs::path& out_dir, std::vector<Job>& jobs) {
+    std::error_code ec;
+    fs::path path(arg);
+    if (arg.find_first_of("*?") != std::string::npos) {
+        fs::path dir = path.parent_path().empty() ? fs::path(".") : path.parent_path();
+        std::string pattern = path.filename().string();
+        std::vector<fs::path> found;
+        for (const auto& entry : fs::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file(ec) && Matches(pattern.c_str(), entry.path().filename().string().c_str()))
+                found.push_back(entry.path());
+        }
+        std::sort(found.begin(), found.end());
+        for (const fs::path& input : found)
+            jobs.push_back({ input, OutputFor(input, input.filename(), out_dir) });
+        return !found.empty();
+    }
+    if (fs::is_directory(path, ec)) {
+        std::vector<fs::path> found;
+        for (const auto& entry : fs::recursive_directory_iterator(path, ec)) {
+            if (entry.is_regular_file(ec) && HasOggExtension(entry.path()))
+                found.push_back(entry.path());
+        }
+        std::sort(found.begin(), found.end());
+        for (const fs::path& input : found)
+            jobs.push_back({ input, OutputFor(input, input.lexically_relative(path), out_dir) });
+        return true;
+    }
+    if (!fs::exists(path, ec))
+        return false;
+    jobs.push_back({ path, OutputFor(path, path.filename(), out_dir) });
+    return true;
+}
+
+static bool ReadManifest(const char* manifest, const fs::path& out_dir, std::vector<Job>& jobs) {
+    std::ifstream in(manifest);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        size_t tab = line.find('\t');
+        fs::path input = line.substr(0, tab);
+        if (tab != std::string::npos)
+            jobs.push_back({ input, line.substr(tab + 1) });
+        else
+            jobs.push_back({ input, OutputFor(input, input.filename(), out_dir) });
+    }
+    return true;
+}
+
+// Whether the output is at least as new as the input and was made the
+// way this run would make it: its mogg version says whether it was
+// encrypted, and its map records the chunk size.
+static bool UpToDate(const Job& job, const Options& opts) {
+    std::error_code ec;
+    auto out_time = fs::last_write_time(job.output, ec);
+    if (ec)
+        return false;
+    auto in_time = fs::last_write_time(job.input, ec);
+    if (ec || out_time < in_time)
+        return false;
+    // Mogg version, header length, then the map's version and chunk size
+    unsigned char header[16];
+    FILE* f = fopen(job.output.string().c_str(), "rb");
+    if (!f)
+        return false;
+    bool read = fread(header, 1, sizeof(header), f) == sizeof(header);
+    fclose(f);
+    auto le32 = [&](int at) {
+        return header[at] | header[at + 1] << 8 | header[at + 2] << 16 | static_cast<uint32_t>(header[at + 3]) << 24;
+    };
+    return read && le32(0) == (opts.encrypt ? 0xBu : 0xAu) && le32(12) == opts.convert.chunk_size;
+}
+
+// Converts through a temporary file beside the output. Returns the
+// library's error code.
+static int Convert(const Job& job, const Options& opts) {
+    std::error_code ec;
+    if (job.output.has_parent_path())
+        fs::create_directories(job.output.parent_path(), ec);
+    fs::path part = job.output;
+    part += ".part";
+    std::string in = job.input.string(), out = part.string();
+    int rc = opts.encrypt
+        ? makemogg_create_encrypted(in.c_str(), out.c_str(), &opts.convert, nullptr)
+        : makemogg_create_unencrypted_ex(in.c_str(), out.c_str(), &opts.convert, nullptr);
+    if (rc == 0) {
+        fs::rename(part, job.output, ec);
+        if (ec)
+            rc = 2;
+    }
+    if (rc != 0)
+        fs::remove(part, ec);
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    makemogg_options_init(&opts.convert);
+    std::vector<std::string> inputs;
+    const char* manifest = nullptr;
+    const char* out_dir = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-e")
+            opts.encrypt = true;
+        else if (arg == "-f")
+            opts.force = true;
+        else if (arg == "-q")
+            opts.quiet = true;
+        else if (arg == "-r")
+            opts.convert.resync = 1;
+        else if (arg == "-c")
+            opts.convert.verify_crc = 1;
+        else if (arg == "-j" && i + 1 < argc)
+            opts.threads = atoi(argv[++i]);
+        else if (arg == "-m" && i + 1 < argc)
+            manifest = argv[++i];
+        else if (arg == "-o" && i + 1 < argc)
+            out_dir = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-')
+            Usage();
+        else
+            inputs.push_back(arg);
+    }
+
+    std::vector<Job> jobs;
+    std::error_code ec;
+    bool single = !manifest && !out_dir && inputs.size() == 2 && !fs::is_directory(inputs[0], ec)
+        && inputs[0].find_first_of("*?") == std::string::npos
+        && !(fs::exists(inputs[1], ec) && HasOggExtension(inputs[1]));
+    if (single) {
+        // makemogg <input> <output>
+        jobs.push_back({ inputs[0], inputs[1] });
+        opts.force = true;
+    } else {
+        if (!manifest && inputs.empty())
+            Usage();
+        fs::path dir = out_dir ? out_dir : "";
+        if (manifest && !ReadManifest(manifest, dir, jobs)) {
+            fprintf(stderr, "makemogg: cannot read manifest %s\n", manifest);
+            return 2;
+        }
+        for (const std::string& input : inputs) {
+            if (!AddInput(input, dir, jobs)) {
+                fprintf(stderr, "makemogg: %s: no such file\n", input.c_str());
+                return 2;
+            }
+        }
+    }
+
+    int threads = opts.threads > 0 ? opts.threads : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, static_cast<int>(jobs.size())));
+    // With files converting side by side the cores are busy already
+    opts.convert.pipeline = threads == 1;
+
+    typedef std::chrono::steady_clock Clock;
+    std::mutex print_lock;
+    std::atomic<size_t> next{ 0 };
+    std::atomic<int> converted{ 0 }, skipped{ 0 }, failed{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    Clock::time_point start = Clock::now();
+
+    auto worker = [&] {
+        for (size_t i; (i = next++) < jobs.size();) {
+            const Job& job = jobs[i];
+            if (!opts.force && UpToDate(job, opts)) {
+                skipped++;
+                continue;
+            }
+            std::error_code ec;
+            uint64_t size = fs::file_size(job.input, ec);
+            Clock::time_point begin = Clock::now();
+            int rc = Convert(job, opts);
+            double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+            std::lock_guard<std::mutex> guard(print_lock);
+            if (rc != 0) {
+                failed++;
+                fprintf(stderr, "%s: %s (code %d)\n", job.input.string().c_str(), Describe(rc), rc);
+                continue;
+            }
+            converted++;
+            bytes += size;
+            if (!opts.quiet)
+                printf("%s -> %s  %.1f MB in %.3f s, %.1f MB/s\n", job.input.string().c_str(),
+                       job.output.string().c_str(), size / 1e6, seconds, size / 1e6 / std::max(seconds, 1e-9));
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool)
+        t.join();
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!single) {
+        printf("%d converted, %d up to date, %d failed: %.1f MB in %.2f s, %.1f MB/s, %d thread%s\n",
+               converted.load(), skipped.load(), failed.load(), bytes / 1e6, seconds,
+               bytes / 1e6 / std::max(seconds, 1e-9), threads, threads == 1 ? "" : "s");
+    }
+    return failed ? 1 : 0;
+}
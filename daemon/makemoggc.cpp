@@ -0,0 +1,131 @@
+// Client for makemoggd: sends conversions to a running daemon and prints
+// the outcome of each, or prints the daemon's counters.
+//
+//   makemoggc [-s socket] [-e] [-r] [-c] [-H] <input> <output> [<input> <output> ...]
+//   makemoggc [-s socket] --stats
+//
+// -e makes encrypted moggs, -r resyncs past damage, -c checks page CRCs and
+// -H prints the XXH64 and SHA-256 of each output. All the files go in one
+// request stream, so the daemon runs as many at once as it has workers.
+// Exits 1 if any conversion failed and 2 if the daemon couldn't be reached
+// or a path can't be sent (see protocol::ValidPath).
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <limits.h>
+
+#include "protocol.h"
+
+static void Usage() {
+    fprintf(stderr,
+            "usage: makemoggc [-s socket] [-e] [-r] [-c] [-H] <input> <output> [<input> <output> ...]\n"
+            "       makemoggc [-s socket] --stats\n");
+    exit(2);
+}
+
+// The daemon resolves paths against its own working directory.
+static std::string Absolute(const std::string& path) {
+    if (!path.empty() && path[0] == '/')
+        return path;
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return path;
+    return std::string(cwd) + '/' + path;
+}
+
+int main(int argc, char** argv) {
+    std::string path = protocol::DefaultSocketPath();
+    std::string flags;
+    bool stats = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+            stats = true;
+        else if (arg == "-s" && i + 1 < argc)
+            path = argv[++i];
+        else if (arg == "-e")
+            flags += 'e';
+        else if (arg == "-r")
+            flags += 'r';
+        else if (arg == "-c")
+            flags += 'c';
+        else if (arg == "-H")
+            flags += 'h';
+        else if (arg.size() > 1 && arg[0] == '-')
+            Usage();
+        else
+            files.push_back(arg);
+    }
+    if (stats ? !files.empty() : files.empty() || files.size() % 2 != 0)
+        Usage();
+    for (const std::string& file : files) {
+        if (!protocol::ValidPath(file)) {
+            fprintf(stderr, "makemoggc: can't send a path that is empty or has a tab, newline or carriage return\n");
+            return 2;
+        }
+    }
+    if (flags.empty())
+        flags = "-";
+
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!protocol::SocketAddress(path, addr) || fd < 0
+        || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        fprintf(stderr, "makemoggc: can't reach makemoggd on %s\n", path.c_str());
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string requests;
+    if (stats) {
+        requests = "stats\n";
+    } else {
+        for (size_t i = 0; i < files.size(); i += 2)
+            requests += "convert\t" + flags + '\t' + Absolute(files[i]) + '\t' + Absolute(files[i + 1]) + '\n';
+    }
+    if (!protocol::WriteAll(fd, requests)) {
+        fprintf(stderr, "makemoggc: lost connection to makemoggd\n");
+        return 2;
+    }
+    shutdown(fd, SHUT_WR);
+
+    protocol::LineReader reader(fd);
+    std::string line;
+    if (stats) {
+        std::vector<std::string> fields;
+        if (!reader.Next(line) || (fields = protocol::SplitTabs(line)).size() != 2 || fields[0] != "stats") {
+            fprintf(stderr, "makemoggc: bad reply from makemoggd\n");
+            return 2;
+        }
+        for (int n = atoi(fields[1].c_str()); n > 0 && reader.Next(line); n--) {
+            fields = protocol::SplitTabs(line);
+            printf("%-14s %s\n", fields[0].c_str(), fields.size() > 1 ? fields[1].c_str() : "");
+        }
+        return 0;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < files.size(); i += 2) {
+        if (!reader.Next(line)) {
+            fprintf(stderr, "makemoggc: lost connection to makemoggd\n");
+            return 2;
+        }
+        std::vector<std::string> fields = protocol::SplitTabs(line);
+        const char* name = files[i].c_str();
+        if (fields.size() == 5 && fields[0] == "ok") {
+            printf("%s: ok, %.1f ms queued, %.1f ms converting\n", name,
+                   atof(fields[1].c_str()) / 1000, atof(fields[2].c_str()) / 1000);
+            if (fields[3] != "-")
+                printf("  xxh64  %s\n  sha256 %s\n", fields[3].c_str(), fields[4].c_str());
+        } else {
+            printf("%s: error %s\n", name, fields.size() > 1 ? fields[1].c_str() : "?");
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+// A resident conversion worker. Jobs arrive over a Unix socket (see
+// protocol.h) and run on a fixed pool of threads, each of which keeps its
+// chunk buffers warm between jobs, so a build system that converts files
+// one by one doesn't pay process startup and cold allocations per file.
+//
+//   makemoggd [-s socket] [-j workers] [-q queue] [-p]
+//
+// -q bounds the jobs waiting for a worker; past it, connections stop being
+// read until one frees up. -p runs each encrypted job on the three-thread
+// pipeline; by default jobs run single-threaded, as the pool already keeps
+// every worker busy. SIGINT or SIGTERM stop accepting, finish the queued
+// jobs and remove the socket.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/stat.h>
+
+#include "makemogg_lib.h"
+#include "MoggWriter.h"
+#include "protocol.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t Microseconds(Clock::duration d) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+// Counts of durations in power-of-two buckets of microseconds: bucket i
+// holds those under 2^i, and at least 2^(i-1).
+class Histogram {
+public:
+    static const int BUCKETS = 40;
+
+    void Add(uint64_t us) {
+        int i = 0;
+        while (i < BUCKETS - 1 && us >> i)
+            i++;
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The upper bound of the bucket holding the given fraction of samples.
+    uint64_t Percentile(double fraction) const {
+        uint64_t counts[BUCKETS], total = 0;
+        for (int i = 0; i < BUCKETS; i++)
+            total += counts[i] = buckets[i].load(std::memory_order_relaxed);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > 0 && seen >= fraction * total)
+                return uint64_t(1) << i;
+        }
+        return 0;
+    }
+
+    // "<upper>:<count>" for each bucket in use.
+    std::string Format() const {
+        std::string s;
+        for (int i = 0; i < BUCKETS; i++) {
+            uint64_t n = buckets[i].load(std::memory_order_relaxed);
+            if (n == 0)
+                continue;
+            if (!s.empty())
+                s += ' ';
+            s += std::to_string(uint64_t(1) << i) + ':' + std::to_string(n);
+        }
+        return s.empty() ? "-" : s;
+    }
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+};
+
+struct Job {
+    std::string input;
+    std::string output;
+    bool encrypt = false;
+    makemogg_options opts;
+    Clock::time_point queued;
+    std::promise<std::string> reply;
+};
+
+class Pool {
+public:
+    Pool(int workers, size_t max_queue, bool pipeline) : max_queue(max_queue), pipeline(pipeline) {
+        for (int i = 0; i < workers; i++)
+            threads.emplace_back([this] { Work(); });
+    }
+
+    // Queues a job, waiting while the queue is full. Once draining, jobs
+    // are refused as cancelled.
+    std::future<std::string> Submit(std::unique_ptr<Job> job) {
+        std::future<std::string> reply = job->reply.get_future();
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [&] { return queue.size() < max_queue || stopping; });
+        if (stopping) {
+            job->reply.set_value("error\t6\t0\t0\n");
+            return reply;
+        }
+        job->queued = Clock::now();
+        queue.push_back(std::move(job));
+        not_empty.notify_one();
+        return reply;
+    }
+
+    // Lets the queued jobs finish, then stops the workers.
+    void Drain() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+        for (std::thread& t : threads)
+            t.join();
+    }
+
+    std::string Stats() {
+        std::vector<std::pair<std::string, std::string>> stats;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stats.emplace_back("workers", std::to_string(threads.size()));
+            stats.emplace_back("queue_limit", std::to_string(max_queue));
+            stats.emplace_back("queued", std::to_string(queue.size()));
+            stats.emplace_back("running", std::to_string(running));
+            stats.emplace_back("completed", std::to_string(completed));
+            stats.emplace_back("failed", std::to_string(failed));
+        }
+        stats.emplace_back("queue_us_p50", std::to_string(wait_us.Percentile(0.5)));
+        stats.emplace_back("queue_us_p99", std::to_string(wait_us.Percentile(0.99)));
+        stats.emplace_back("queue_us", wait_us.Format());
+        stats.emplace_back("run_us_p50", std::to_string(run_us.Percentile(0.5)));
+        stats.emplace_back("run_us_p99", std::to_string(run_us.Percentile(0.99)));
+        stats.emplace_back("run_us", run_us.Format());
+        std::string reply = "stats\t" + std::to_string(stats.size()) + "\n";
+        for (auto& stat : stats)
+            reply += stat.first + '\t' + stat.second + '\n';
+        return reply;
+    }
+
+private:
+    void Work() {
+        // Keep this worker's chunk buffers between jobs, and fault in its
+        // writer buffer before the first
+        MoggWriter::CacheChunks(true);
+        size_t chunk = MoggWriter::DEFAULT_CHUNK_SIZE;
+        uint8_t* warm = MoggWriter::AllocateChunk(chunk);
+        memset(warm, 0, chunk);
+        MoggWriter::FreeChunk(warm, chunk);
+
+        for (;;) {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                not_empty.wait(guard, [&] { return !queue.empty() || stopping; });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+                running++;
+            }
+            not_full.notify_one();
+            Clock::time_point start = Clock::now();
+            makemogg_result result;
+            job->opts.pipeline = pipeline;
+            int rc = job->encrypt
+                ? makemogg_create_encrypted(job->input.c_str(), job->output.c_str(), &job->opts, &result)
+                : makemogg_create_unencrypted_ex(job->input.c_str(), job->output.c_str(), &job->opts, &result);
+            uint64_t waited = Microseconds(start - job->queued);
+            uint64_t ran = Microseconds(Clock::now() - start);
+            wait_us.Add(waited);
+            run_us.Add(ran);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                running--;
+                completed++;
+                if (rc != 0)
+                    failed++;
+            }
+            std::string times = std::to_string(waited) + '\t' + std::to_string(ran);
+            if (rc != 0) {
+                job->reply.set_value("error\t" + std::to_string(rc) + '\t' + times + '\n');
+                continue;
+            }
+            std::string xxh64 = "-", sha256 = "-";
+            char hex[65];
+            if (result.hashes & MAKEMOGG_HASH_XXH64) {
+                snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(result.xxh64));
+                xxh64 = hex;
+            }
+            if (result.hashes & MAKEMOGG_HASH_SHA256) {
+                for (int i = 0; i < 32; i++)
+                    snprintf(hex + 2 * i, 3, "%02x", result.sha256[i]);
+                sha256 = hex;
+            }
+            job->reply.set_value("ok\t" + times + '\t' + xxh64 + '\t' + sha256 + '\n');
+        }
+    }
+
+    const size_t max_queue;
+    const bool pipeline;
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::unique_ptr<Job>> queue;
+    bool stopping = false;
+    uint64_t running = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    Histogram wait_us;
+    Histogram run_us;
+};
+
+static std::future<std::string> Ready(const std::string& reply) {
+    std::promise<std::string> promise;
+    promise.set_value(reply);
+    return promise.get_future();
+}
+
+// Parses a request into a queued job, or an immediate reply.
+static std::future<std::string> Handle(const std::string& line, Pool& pool) {
+    std::vector<std::string> fields = protocol::SplitTabs(line);
+    if (fields.size() == 1 && fields[0] == "stats")
+        return Ready(pool.Stats());
+    if (fields.size() != 4 || fields[0] != "convert" || fields[1].empty()
+        || !protocol::ValidPath(fields[2]) || !protocol::ValidPath(fields[3]))
+        return Ready("error\t4\t0\t0\n");
+    auto job = std::make_unique<Job>();
+    job->input = fields[2];
+    job->output = fields[3];
+    makemogg_options_init(&job->opts);
+    for (char flag : fields[1]) {
+        switch (flag) {
+            case 'e': job->encrypt = true; break;
+            case 'r': job->opts.resync = 1; break;
+            case 'c': job->opts.verify_crc = 1; break;
+            case 'h': job->opts.hash = MAKEMOGG_HASH_XXH64 | MAKEMOGG_HASH_SHA256; break;
+            case '-': break;
+            default: return Ready("error\t4\t0\t0\n");
+        }
+    }
+    return pool.Submit(std::move(job));
+}
+
+// Reads requests from one client and writes the replies back in order from
+// a second thread, so the jobs of a client that sends several run at once.
+static void Serve(int fd, Pool& pool) {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::future<std::string>> pending;
+    bool done = false;
+
+    std::thread writer([&] {
+        bool ok = true;
+        for (;;) {
+            std::future<std::string> reply;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return !pending.empty() || done; });
+                if (pending.empty())
+                    return;
+                reply = std::move(pending.front());
+                pending.pop_front();
+            }
+            // Keep waiting for the rest after a write fails, so none of the
+            // jobs outlive this connection
+            std::string text = reply.get();
+            ok = ok && protocol::WriteAll(fd, text);
+        }
+    });
+
+    protocol::LineReader reader(fd);
+    std::string line;
+    while (reader.Next(line)) {
+        std::future<std::string> reply = Handle(line, pool);
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(std::move(reply));
+        changed.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    changed.notify_one();
+    writer.join();
+    close(fd);
+}
+
+static int stopPipe[2];
+
+static void OnSignal(int) {
+    char c = 0;
+    ssize_t ignored = write(stopPipe[1], &c, 1);
+    (void)ignored;
+}
+
+static void Usage() {
+    fprintf(stderr, "usage: makemoggd [-s socket] [-j workers] [-q queue] [-p]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    std::string path = protocol::DefaultSocketPath();
+    int workers = static_cast<int>(std::thread::hardware_concurrency());
+    size_t max_queue = 0;
+    bool pipeline = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-p") {
+            pipeline = true;
+        } else if (i + 1 < argc && arg == "-s") {
+            path = argv[++i];
+        } else if (i + 1 < argc && arg == "-j") {
+            workers = atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "-q") {
+            max_queue = static_cast<size_t>(atol(argv[++i]));
+        } else {
+            Usage();
+        }
+    }
+    if (workers < 1)
+        workers = 1;
+    if (max_queue == 0)
+        max_queue = 16 * static_cast<size_t>(workers);
+
+    sockaddr_un addr;
+    if (!protocol::SocketAddress(path, addr)) {
+        fprintf(stderr, "makemoggd: socket path too long: %s\n", path.c_str());
+        return 1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("makemoggd: socket");
+        return 1;
+    }
+    // A socket file nobody answers on is left over from a daemon that died
+    if (connect(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        fprintf(stderr, "makemoggd: already running on %s\n", path.c_str());
+        return 1;
+    }
+    close(listener);
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str());
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t mask = umask(077);
+    int bound = bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(mask);
+    if (bound != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "makemoggd: %s: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    if (pipe(stopPipe) != 0) {
+        perror("makemoggd: pipe");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    // Never freed: connection threads may still be using it as we exit
+    Pool& pool = *new Pool(workers, max_queue, pipeline);
+    fprintf(stderr, "makemoggd: %d workers on %s\n", workers, path.c_str());
+    for (;;) {
+        pollfd fds[2] = { { listener, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("makemoggd: poll");
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        std::thread([fd, &pool] { Serve(fd, pool); }).detach();
+    }
+    close(listener);
+    unlink(path.c_str());
+    pool.Drain();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// The makemoggd protocol: lines over a Unix stream socket. Each request is
+// one line of tab-separated fields and gets one reply line, in the order
+// the requests were sent, so a client can send many before reading any.
+//
+//   convert <flags> <input> <output>
+//       ok <queue_us> <run_us> <xxh64> <sha256>
+//       error <code> <queue_us> <run_us>
+//   stats
+//       stats <n>, then n lines of "<name> <value>"
+//
+// flags are any of e (encrypt), r (resync), c (verify CRCs) and h (hash
+// the output), or "-" for none; hashes are "-" unless asked for. Error
+// codes are those of the makemogg_create functions. Paths are used as
+// given, relative to the daemon's working directory, so clients should send
+// absolute ones; they can't be empty or contain tabs, newlines, carriage
+// returns or NULs (see ValidPath), and a request with such a field gets
+// error 4.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace protocol {
+
+// $XDG_RUNTIME_DIR/makemoggd.sock, or one per user in /tmp.
+inline std::string DefaultSocketPath() {
+    if (const char* dir = getenv("XDG_RUNTIME_DIR"))
+        return std::string(dir) + "/makemoggd.sock";
+    return "/tmp/makemoggd-" + std::to_string(getuid()) + ".sock";
+}
+
+// Fills a socket address, or returns false if the path is too long for one.
+inline bool SocketAddress(const std::string& path, sockaddr_un& addr) {
+    addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    path.copy(addr.sun_path, path.size());
+    return true;
+}
+
+// Both ends ignore SIGPIPE, so a peer that has gone makes this fail
+// rather than killing the process.
+inline bool WriteAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads a socket a line at a time.
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    // Returns false at end of stream or on error. The newline is dropped.
+    bool Next(std::string& line) {
+        for (;;) {
+            size_t end = buffer.find('\n', start);
+            if (end != std::string::npos) {
+                line.assign(buffer, start, end - start);
+                start = end + 1;
+                return true;
+            }
+            buffer.erase(0, start);
+            start = 0;
+            char chunk[4096];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+private:
+    int fd;
+    std::string buffer;
+    size_t start = 0;
+};
+
+// Whether a path can go in a request field as it is. Anything else could
+// split the field, end the request early or be cut short by the daemon.
+inline bool ValidPath(const std::string& path) {
+    return !path.empty() && path.find_first_of(std::string("\t\n\r\0", 4)) == std::string::npos;
+}
+
+inline std::vector<std::string> SplitTabs(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == std::string::npos)
+            return fields;
+        start = tab + 1;
+    }
+}
+
+}
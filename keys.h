@@ -1,3 +1,3 @@
-const unsigned char ctrKey0B[16] = {
+constexpr unsigned char ctrKey0B[16] = {
  0x37, 0xB2, 0xE2, 0xB9, 0x1C, 0x74, 0xFA, 0x9E, 0x38, 0x81, 0x08, 0xEA, 0x36, 0x23, 0xDB, 0xE4
 };
@@ -2,42 +2,1067 @@
 #include "makemogg_lib.h"
 #include "OggMap.h"
 #include "CCallbacks.h"
+#include "DirectFile.h"
+#include "FdDatasource.h"
+#include "Hash.h"
+#include "ByteOrder.h"
+#include "MoggWriter.h"
+#include "OggClip.h"
+#include "oggcrc.h"
+#include "oggvorbis.h"
+#include "EncryptPipeline.h"
+#include "Executor.h"
+#include "UringBatch.h"
+#include "VorbisEncrypter.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <variant>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+void makemogg_options_init(makemogg_options* opts) {
+    *opts = makemogg_options{};
+    opts->chunk_size = OggMapOptions().chunk_size;
+    opts->seek_increment = OggMapOptions().seek_increment;
+    opts->write_chunk_size = MoggWriter::DEFAULT_CHUNK_SIZE;
+    opts->progress_interval = 1 << 20;
+    opts->pipeline = 1;
+    opts->io_uring = 1;
+    opts->batch_memory = 256 << 20;
+}
 
 int makemogg_create_unencrypted(const char* input_path, const char* output_path) {
-    std::ifstream infile(input_path, std::ios::in | std::ios::binary);
-    if (!infile.is_open()) {
+    return makemogg_create_unencrypted_ex(input_path, output_path, nullptr, nullptr);
+}
+
+// Forwards progress to the caller's callback, and remembers a cancel so it
+// can be told apart from other errors once it has unwound.
+struct Progress {
+    explicit Progress(const makemogg_options* opts) : opts(opts) {}
+
+    // Returns false if the conversion should stop.
+    bool Report(int stage, uint64_t position, bool force = false) {
+        if (!opts->progress || cancelled)
+            return !cancelled;
+        if (stage != current_stage) {
+            current_stage = stage;
+            next = 0;
+        }
+        if (position < next && !force)
+            return true;
+        next = position + opts->progress_interval;
+        cancelled = opts->progress(opts->progress_user, stage, position,
+                                   stage == MAKEMOGG_STAGE_MAP ? input_size : output_size) != 0;
+        return !cancelled;
+    }
+
+    static int FromScanner(void* user, uint64_t position) {
+        return static_cast<Progress*>(user)->Report(MAKEMOGG_STAGE_MAP, position) ? 0 : 1;
+    }
+
+    const makemogg_options* opts;
+    uint64_t input_size = 0;
+    uint64_t output_size = 0;
+    int current_stage = -1;
+    uint64_t next = 0;
+    bool cancelled = false;
+};
+
+static uint64_t InputSize(void* input, ov_callbacks in_cb) {
+    in_cb.seek_func(input, 0, SEEK_END);
+    long size = in_cb.tell_func(input);
+    in_cb.seek_func(input, 0, SEEK_SET);
+    return size < 0 ? 0 : static_cast<uint64_t>(size);
+}
+
+static OggMapOptions MapOptionsFrom(const makemogg_options* opts, Progress* progress) {
+    OggMapOptions mapOptions;
+    mapOptions.scan.resync = opts->resync != 0;
+    mapOptions.scan.verify_crc = opts->verify_crc != 0;
+    if (opts->chunk_size)
+        mapOptions.chunk_size = opts->chunk_size;
+    if (opts->seek_increment)
+        mapOptions.seek_increment = opts->seek_increment;
+    mapOptions.exact_pages = opts->exact_seek_points != 0;
+    if (opts->progress && progress) {
+        mapOptions.scan.progress = Progress::FromScanner;
+        mapOptions.scan.progress_user = progress;
+        mapOptions.scan.progress_interval = opts->progress_interval;
+    }
+    return mapOptions;
+}
+
+static void FillResult(makemogg_result* result, const OggMap::ScanReport& report) {
+    if (result) {
+        result->skipped_bytes = report.skipped_bytes;
+        result->skipped_regions = report.skipped_regions;
+        result->crc_failures = report.crc_failures;
+        result->hashes = 0;
+    }
+}
+
+// Writes a conversion's prefetch table to opts->prefetch_path, if set.
+// Returns 0, 2 if the file can't be created or 5 if writing it fails.
+static int WritePrefetch(const makemogg_options* opts, const std::vector<uint8_t>& table) {
+    if (!opts->prefetch_path)
+        return 0;
+    FILE* file = fopen(opts->prefetch_path, "wb");
+    if (!file)
+        return 2;
+    bool ok = fwrite(table.data(), 1, table.size(), file) == table.size();
+    return fclose(file) == 0 && ok ? 0 : 5;
+}
+
+// Shared by the path and callback entry points. The input is read through
+// its callbacks from its start and is never closed.
+static int CreateUnencrypted(void* input, ov_callbacks in_cb, MoggWriter& out,
+                             const makemogg_options* opts, makemogg_result* result) {
+    Progress progress(opts);
+    progress.input_size = InputSize(input, in_cb);
+    OggMapOptions mapOptions = MapOptionsFrom(opts, &progress);
+    mapOptions.prefetch = opts->prefetch_path != nullptr;
+    auto created = OggMap::Create(input, in_cb, mapOptions);
+    if (std::holds_alternative<std::string>(created)) {
+        // Error creating OggMap
+        return progress.cancelled ? 6 : 3;
+    }
+    auto& map = std::get<OggMap>(created);
+    FillResult(result, map.report);
+    // Version, Ogg data offset and the map, built in place in the output
+    // buffer when it fits
+    size_t headerSize = 8 + map.GetLength();
+    std::vector<uint8_t> prefetch;
+    if (mapOptions.prefetch)
+        prefetch = map.SerializePrefetch(static_cast<uint32_t>(headerSize));
+    progress.output_size = headerSize + (progress.input_size - map.report.data_offset);
+    size_t available;
+    uint8_t* header = out.Reserve(&available);
+    std::vector<uint8_t> spill;
+    if (available < headerSize) {
+        spill.resize(headerSize);
+        header = spill.data();
+    }
+    store_le32(header, 0xA);
+    store_le32(header + 4, static_cast<uint32_t>(headerSize));
+    map.SerializeTo(header + 8, headerSize - 8);
+    if (!(spill.empty() ? out.Commit(headerSize) : out.Write(spill.data(), headerSize)))
+        return 5;
+    // Copy the audio data, leaving out any junk before the first page
+    if (in_cb.seek_func(input, map.report.data_offset, SEEK_SET) != 0)
+        return 3;
+    for (;;) {
+        uint8_t* dst = out.Reserve(&available);
+        size_t read = in_cb.read_func(dst, 1, available, input);
+        if (read == 0)
+            break;
+        if (!out.Commit(read))
+            return 5;
+        if (!progress.Report(MAKEMOGG_STAGE_WRITE, out.BytesWritten()))
+            return 6;
+    }
+    if (!out.Flush())
+        return 5;
+    if (!progress.Report(MAKEMOGG_STAGE_WRITE, out.BytesWritten(), true))
+        return 6;
+    return WritePrefetch(opts, prefetch);
+}
+
+static int IvOptionsFrom(const makemogg_options* opts, IvOptions& iv) {
+    switch (opts->iv_mode) {
+        case MAKEMOGG_IV_RANDOM: iv.mode = IvOptions::RANDOM; break;
+        case MAKEMOGG_IV_SEED: iv.mode = IvOptions::SEED; break;
+        case MAKEMOGG_IV_INPUT_HASH: iv.mode = IvOptions::INPUT_HASH; break;
+        default: return 4; // Invalid options
+    }
+    if (iv.mode == IvOptions::SEED) {
+        if (!opts->iv_seed && opts->iv_seed_length) {
+            return 4;
+        }
+        auto* seed = static_cast<const uint8_t*>(opts->iv_seed);
+        iv.seed.assign(seed, seed + opts->iv_seed_length);
+    }
+    return 0;
+}
+
+static int CreateEncrypted(void* input, ov_callbacks in_cb, MoggWriter& out,
+                           const makemogg_options* opts, makemogg_result* result) {
+    IvOptions iv;
+    if (int rc = IvOptionsFrom(opts, iv))
+        return rc;
+    // An unencrypted mogg gets its existing map; anything else is mapped
+    // as plain ogg
+    char magic[4];
+    bool isMogg = in_cb.read_func(magic, 1, sizeof(magic), input) == sizeof(magic)
+        && load_le32(magic) == 0xA;
+    if (in_cb.seek_func(input, 0, SEEK_SET) != 0)
+        return 3;
+    // Only a scan of plain ogg builds a prefetch table
+    if (isMogg && opts->prefetch_path)
+        return 4;
+    // The caller owns the input
+    in_cb.close_func = nullptr;
+    Progress progress(opts);
+    progress.input_size = InputSize(input, in_cb);
+    std::vector<uint8_t> prefetch;
+    try {
+        std::unique_ptr<VorbisEncrypter> encrypter;
+        if (isMogg) {
+            encrypter.reset(new VorbisEncrypter(input, in_cb, iv));
+        } else {
+            OggMapOptions mapOptions = MapOptionsFrom(opts, &progress);
+            mapOptions.prefetch = opts->prefetch_path != nullptr;
+            encrypter.reset(new VorbisEncrypter(input, 0x10, in_cb, mapOptions, iv));
+        }
+        FillResult(result, encrypter->GetReport());
+        prefetch = encrypter->GetPrefetch();
+        progress.output_size = encrypter->GetLength();
+        if (opts->pipeline) {
+            bool ok = EncryptPipeline::Run(*encrypter, out, [&](uint64_t written) {
+                return progress.Report(MAKEMOGG_STAGE_WRITE, written);
+            });
+            if (!ok)
+                return out.Failed() ? 5 : 6;
+            if (!progress.Report(MAKEMOGG_STAGE_WRITE, out.BytesWritten(), true))
+                return 6;
+            return WritePrefetch(opts, prefetch);
+        }
+        size_t available;
+        for (;;) {
+            uint8_t* dst = out.Reserve(&available);
+            size_t read = encrypter->ReadRaw(dst, 1, available);
+            if (read == 0)
+                break;
+            if (!out.Commit(read))
+                return 5;
+            if (!progress.Report(MAKEMOGG_STAGE_WRITE, out.BytesWritten()))
+                return 6;
+        }
+    } catch (const std::runtime_error&) {
+        // Error reading the source or creating the OggMap
+        return progress.cancelled ? 6 : 3;
+    }
+    if (!out.Flush())
+        return 5;
+    if (!progress.Report(MAKEMOGG_STAGE_WRITE, out.BytesWritten(), true))
+        return 6;
+    return WritePrefetch(opts, prefetch);
+}
+
+// A path opened for reading: with pread on POSIX, or an ifstream elsewhere.
+struct InputFile {
+    explicit InputFile(const char* path, size_t buffer_size = 1 << 20) {
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+        datasource = fd_datasource_open(path, buffer_size);
+        callbacks = fdCallbacks;
+#else
+        (void)buffer_size;
+        stream.open(path, std::ios::in | std::ios::binary);
+        if (stream.is_open())
+            datasource = &stream;
+        callbacks = cppCallbacks;
+#endif
+    }
+    ~InputFile() {
+        if (datasource)
+            callbacks.close_func(datasource);
+    }
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    // Evicts the file from the page cache once it won't be read again.
+    void DropCache() {
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+        fd_datasource_drop_cache(static_cast<FdDatasource*>(datasource));
+#endif
+    }
+
+    void* datasource = nullptr;
+    ov_callbacks callbacks;
+#if !defined(MOGG_HAVE_FD_DATASOURCE)
+    std::ifstream stream;
+#endif
+};
+
+// A path opened for writing: through an ofstream, or a DirectFile when
+// direct I/O was asked for on a platform that has it.
+struct OutputFile {
+    OutputFile(const char* path, bool direct) {
+#if defined(MOGG_HAVE_DIRECT_FILE)
+        if (direct) {
+            file = direct_file_open(path);
+            sink = file;
+            callbacks = directWriteCallbacks;
+            return;
+        }
+#else
+        (void)direct;
+#endif
+        stream.open(path, std::ios::out | std::ios::binary);
+        if (stream.is_open())
+            sink = &stream;
+        callbacks = cppWriteCallbacks;
+    }
+    ~OutputFile() {
+        Close();
+    }
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    // Returns false if the last of the data couldn't be written out.
+    bool Close() {
+        bool ok = true;
+#if defined(MOGG_HAVE_DIRECT_FILE)
+        if (file) {
+            ok = direct_file_close(file) == 0;
+            file = nullptr;
+        }
+#endif
+        if (stream.is_open()) {
+            stream.close();
+            ok = !stream.fail();
+        }
+        sink = nullptr;
+        return ok;
+    }
+
+    void* sink = nullptr;
+    mogg_write_callbacks callbacks;
+    std::ofstream stream;
+#if defined(MOGG_HAVE_DIRECT_FILE)
+    DirectFile* file = nullptr;
+#endif
+};
+
+// The hashes asked for in opts->hash, fed everything a MoggWriter writes.
+struct OutputHashes {
+    explicit OutputHashes(const makemogg_options* opts) : which(opts->hash) {}
+
+    void Attach(MoggWriter& out) {
+        out.HashWith(which & MAKEMOGG_HASH_XXH64 ? &xxh64 : nullptr,
+                     which & MAKEMOGG_HASH_SHA256 ? &sha256 : nullptr);
+    }
+
+    static bool Valid(const makemogg_options* opts) {
+        return (opts->hash & ~(MAKEMOGG_HASH_XXH64 | MAKEMOGG_HASH_SHA256)) == 0;
+    }
+
+    // Stores the digests, or clears them if the conversion failed.
+    void Fill(makemogg_result* result, int rc) const {
+        if (!result)
+            return;
+        result->hashes = rc == 0 ? which : 0;
+        result->xxh64 = result->hashes & MAKEMOGG_HASH_XXH64 ? xxh64.Digest() : 0;
+        std::memset(result->sha256, 0, sizeof(result->sha256));
+        if (result->hashes & MAKEMOGG_HASH_SHA256)
+            sha256.Digest(result->sha256);
+    }
+
+    uint32_t which;
+    Xxh64 xxh64;
+    Sha256 sha256;
+};
+
+// Runs a conversion between two paths, or between caller callbacks.
+typedef int (*CreateFunc)(void*, ov_callbacks, MoggWriter&, const makemogg_options*, makemogg_result*);
+
+static int CreateFromPaths(CreateFunc create, const char* input_path, const char* output_path,
+                           const makemogg_options* opts, makemogg_result* result) {
+    makemogg_options defaults;
+    if (!opts) {
+        makemogg_options_init(&defaults);
+        opts = &defaults;
+    }
+    if (!OutputHashes::Valid(opts)) {
+        return 4;
+    }
+    InputFile infile(input_path);
+    if (!infile.datasource) {
         return 1; // Could not open input file
     }
-    std::ofstream outfile(output_path, std::ios::out | std::ios::binary);
-    if (!outfile.is_open()) {
+    OutputFile outfile(output_path, opts->direct_io != 0);
+    if (!outfile.sink) {
         return 2; // Could not open output file
     }
-    auto result = OggMap::Create(&infile, cppCallbacks);
-    if (std::holds_alternative<std::string>(result)) {
-        // Error creating OggMap
+    int rc;
+    OutputHashes hashes(opts);
+    {
+        MoggWriter out(outfile.sink, outfile.callbacks, opts->write_chunk_size);
+        hashes.Attach(out);
+        rc = create(infile.datasource, infile.callbacks, out, opts, result);
+    }
+    if (opts->direct_io) {
+        infile.DropCache();
+    }
+    if (!outfile.Close() && rc == 0) {
+        rc = 5;
+    }
+    if (rc == 6) {
+        // Don't leave a truncated mogg behind
+        std::remove(output_path);
+    }
+    hashes.Fill(result, rc);
+    return rc;
+}
+
+static int CreateFromCallbacks(CreateFunc create, void* input, ov_callbacks in_cb,
+                               void* output, mogg_write_callbacks out_cb,
+                               const makemogg_options* opts, makemogg_result* result) {
+    makemogg_options defaults;
+    if (!opts) {
+        makemogg_options_init(&defaults);
+        opts = &defaults;
+    }
+    if (!in_cb.read_func || !in_cb.seek_func || !in_cb.tell_func || !out_cb.write_func
+        || !OutputHashes::Valid(opts)) {
+        return 4;
+    }
+    MoggWriter out(output, out_cb, opts->write_chunk_size);
+    OutputHashes hashes(opts);
+    hashes.Attach(out);
+    int rc = create(input, in_cb, out, opts, result);
+    hashes.Fill(result, rc);
+    return rc;
+}
+
+int makemogg_create_unencrypted_ex(const char* input_path, const char* output_path,
+                                   const makemogg_options* opts, makemogg_result* result) {
+    return CreateFromPaths(CreateUnencrypted, input_path, output_path, opts, result);
+}
+
+int makemogg_create_encrypted(const char* input_path, const char* output_path,
+                              const makemogg_options* opts, makemogg_result* result) {
+    return CreateFromPaths(CreateEncrypted, input_path, output_path, opts, result);
+}
+
+int makemogg_create_unencrypted_cb(void* input, ov_callbacks input_callbacks,
+                                   void* output, mogg_write_callbacks output_callbacks,
+                                   const makemogg_options* opts, makemogg_result* result) {
+    return CreateFromCallbacks(CreateUnencrypted, input, input_callbacks,
+                               output, output_callbacks, opts, result);
+}
+
+int makemogg_create_encrypted_cb(void* input, ov_callbacks input_callbacks,
+                                 void* output, mogg_write_callbacks output_callbacks,
+                                 const makemogg_options* opts, makemogg_result* result) {
+    return CreateFromCallbacks(CreateEncrypted, input, input_callbacks,
+                               output, output_callbacks, opts, result);
+}
+
+int makemogg_convert_batch(makemogg_job* jobs, size_t count, const makemogg_options* opts) {
+    makemogg_options defaults;
+    if (opts) {
+        // One prefetch path can't serve every job
+        defaults = *opts;
+        defaults.prefetch_path = nullptr;
+    } else {
+        makemogg_options_init(&defaults);
+    }
+    opts = &defaults;
+    std::vector<BatchJob> batch(count);
+    for (size_t i = 0; i < count; i++) {
+        batch[i].input_path = jobs[i].input_path;
+        batch[i].output_path = jobs[i].output_path;
+        batch[i].encrypt = jobs[i].encrypt != 0;
+    }
+    IvOptions iv;
+    bool ran = false;
+    // The batch writes each mogg's header and data unaligned, which direct
+    // I/O can't do, and straight from its arena without hashing them
+    if (opts->io_uring && !opts->direct_io && !opts->hash && IvOptionsFrom(opts, iv) == 0) {
+        ran = RunUringBatch(batch, MapOptionsFrom(opts, nullptr), iv,
+                            opts->batch_memory ? opts->batch_memory : 256 << 20);
+    }
+    int failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        makemogg_job& job = jobs[i];
+        job.result = makemogg_result{};
+        if (ran && batch[i].result != -1) {
+            job.status = batch[i].result;
+            FillResult(&job.result, batch[i].report);
+        } else if (job.encrypt) {
+            job.status = makemogg_create_encrypted(job.input_path, job.output_path, opts, &job.result);
+        } else {
+            job.status = makemogg_create_unencrypted_ex(job.input_path, job.output_path, opts, &job.result);
+        }
+        if (job.status != 0)
+            failed++;
+    }
+    return failed;
+}
+
+// The write end behind makemogg_completion_fd, -1 until it is opened.
+static std::atomic<int> completionSignal{ -1 };
+
+int makemogg_completion_fd(void) {
+#if defined(_WIN32)
+    return -1;
+#else
+    static const int fd = [] {
+#if defined(__linux__)
+        int event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        completionSignal.store(event, std::memory_order_release);
+        return event;
+#else
+        int ends[2];
+        if (pipe(ends) != 0)
+            return -1;
+        for (int end : ends) {
+            fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+            fcntl(end, F_SETFD, FD_CLOEXEC);
+        }
+        completionSignal.store(ends[1], std::memory_order_release);
+        return ends[0];
+#endif
+    }();
+    return fd;
+#endif
+}
+
+static void SignalCompletion() {
+#if !defined(_WIN32)
+    int fd = completionSignal.load(std::memory_order_acquire);
+    if (fd < 0)
+        return;
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+#else
+    // A full pipe is readable already, so a failed write loses nothing
+    ssize_t n = write(fd, "", 1);
+#endif
+    (void)n;
+#endif
+}
+
+// Held by the caller's handle and by the executor until the job is done,
+// so either may let go first.
+struct makemogg_task : ExecutorTask {
+    makemogg_job* job;
+    makemogg_options opts;
+    makemogg_complete_func on_complete;
+    void* user;
+    std::atomic<int> refs{ 2 };
+    std::atomic<bool> done{ false };
+    std::mutex lock;
+    std::condition_variable finished;
+
+    void Run() override {
+        job->result = makemogg_result{};
+        job->status = job->encrypt
+            ? makemogg_create_encrypted(job->input_path, job->output_path, &opts, &job->result)
+            : makemogg_create_unencrypted_ex(job->input_path, job->output_path, &opts, &job->result);
+        // The callback comes first, so nobody who sees the task done frees
+        // what it uses while it runs
+        if (on_complete)
+            on_complete(user, job);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done.store(true, std::memory_order_release);
+        }
+        finished.notify_all();
+        SignalCompletion();
+        Release();
+    }
+
+    void Release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+};
+
+makemogg_task* makemogg_submit(makemogg_job* job, const makemogg_options* opts,
+                               makemogg_complete_func on_complete, void* user) {
+    makemogg_task* task = new (std::nothrow) makemogg_task;
+    if (!task)
+        return nullptr;
+    task->job = job;
+    if (opts) {
+        task->opts = *opts;
+    } else {
+        makemogg_options_init(&task->opts);
+        task->opts.pipeline = 0;
+    }
+    task->on_complete = on_complete;
+    task->user = user;
+    Executor::Shared().Submit(task);
+    return task;
+}
+
+int makemogg_task_done(const makemogg_task* task) {
+    return task->done.load(std::memory_order_acquire);
+}
+
+int makemogg_task_wait(makemogg_task* task) {
+    std::unique_lock<std::mutex> guard(task->lock);
+    task->finished.wait(guard, [task] { return task->done.load(std::memory_order_acquire); });
+    return task->job->status;
+}
+
+void makemogg_task_free(makemogg_task* task) {
+    if (task)
+        task->Release();
+}
+
+// Moves `length` bytes of payload from `from` to `to` in the same file, a
+// block at a time, back to front when moving towards the end so nothing is
+// overwritten before it has been read. `transform`, if set, is applied to
+// each block, given its offset into the payload, before it is written.
+// Returns 0, 3 on a short read or 5 on a failed write.
+static int ShiftPayload(FILE* file, uint64_t from, uint64_t to, uint64_t length, size_t block,
+                        const std::function<void(uint8_t*, size_t, uint64_t)>& transform,
+                        Progress& progress) {
+    if (from == to && !transform)
+        return 0;
+    std::vector<uint8_t> buffer(block);
+    bool backwards = to > from;
+    for (uint64_t done = 0; done < length;) {
+        size_t n = length - done < block ? static_cast<size_t>(length - done) : block;
+        uint64_t pos = backwards ? length - done - n : done;
+        if (mogg_fseek64(file, static_cast<int64_t>(from + pos), SEEK_SET) != 0
+            || fread(buffer.data(), 1, n, file) != n)
+            return 3;
+        if (transform)
+            transform(buffer.data(), n, pos);
+        if (mogg_fseek64(file, static_cast<int64_t>(to + pos), SEEK_SET) != 0
+            || fwrite(buffer.data(), 1, n, file) != n)
+            return 5;
+        done += n;
+        progress.Report(MAKEMOGG_STAGE_WRITE, done);
+    }
+    return 0;
+}
+
+int makemogg_encrypt_in_place(const char* mogg_path, const makemogg_options* opts, makemogg_result* result) {
+    makemogg_options defaults;
+    if (!opts) {
+        makemogg_options_init(&defaults);
+        opts = &defaults;
+    }
+    IvOptions iv;
+    if (int rc = IvOptionsFrom(opts, iv))
+        return rc;
+    FILE* file = fopen(mogg_path, "r+b");
+    if (!file) {
+        return 1;
+    }
+    ov_callbacks cb = cCallbacks;
+    cb.close_func = nullptr;
+    int rc;
+    try {
+        VorbisEncrypter encrypter(file, cb, iv);
+        FillResult(result, encrypter.GetReport());
+        const std::vector<uint8_t>& header = encrypter.GetHeader();
+        uint64_t payload = encrypter.GetLength() - header.size();
+        Progress progress(opts);
+        progress.output_size = payload;
+        size_t block = opts->write_chunk_size ? opts->write_chunk_size : MoggWriter::DEFAULT_CHUNK_SIZE;
+        rc = ShiftPayload(file, encrypter.GetSourceOffset(), header.size(), payload, block,
+                          [&](uint8_t* data, size_t length, uint64_t pos) {
+                              encrypter.EncryptAt(data, length, pos);
+                          }, progress);
+        // The new header goes last, so a mogg that fails partway through
+        // is never mistaken for a good 0xB
+        if (rc == 0 && (fseek(file, 0, SEEK_SET) != 0
+                        || fwrite(header.data(), 1, header.size(), file) != header.size()))
+            rc = 5;
+    } catch (const std::runtime_error&) {
+        // Not an 0xA mogg, or its header couldn't be read
+        rc = 3;
+    }
+    if (fclose(file) != 0 && rc == 0)
+        rc = 5;
+    return rc;
+}
+
+// The Ogg data of a mogg, read through ov_callbacks as if it were a plain
+// ogg file and decrypted on the way when the mogg is 0xB.
+struct PayloadFile {
+    FILE* file;
+    uint32_t version; // 0xA, 0xB, or 0 for a plain ogg
+    uint64_t offset;
+    uint64_t length;
+    uint64_t pos;
+    const uint8_t* iv; // NULL unless 0xB
+    uint8_t iv_bytes[16];
+};
+
+// Finds the payload of an 0xA or 0xB mogg, reading its header, or with
+// allow_ogg, treats anything else as a plain ogg. Returns false if the
+// file isn't one of those.
+static bool OpenPayload(FILE* file, PayloadFile& payload, bool allow_ogg) {
+    payload = PayloadFile{ file, 0, 0, 0, 0, nullptr, {} };
+    uint8_t head[8];
+    bool read = fread(head, 1, sizeof(head), file) == sizeof(head);
+    if (mogg_fseek64(file, 0, SEEK_END) != 0)
+        return false;
+    int64_t size = mogg_ftell64(file);
+    if (size < 0)
+        return false;
+    uint32_t version = read ? load_le32(head) : 0;
+    if (version != 0xA && version != 0xB) {
+        payload.length = static_cast<uint64_t>(size);
+        return allow_ogg;
+    }
+    uint64_t offset = load_le32(head + 4);
+    bool encrypted = version == 0xB;
+    if (offset < (encrypted ? 24u : 8u) || offset > static_cast<uint64_t>(size))
+        return false;
+    if (encrypted) {
+        if (mogg_fseek64(file, static_cast<int64_t>(offset - sizeof(payload.iv_bytes)), SEEK_SET) != 0
+            || fread(payload.iv_bytes, 1, sizeof(payload.iv_bytes), file) != sizeof(payload.iv_bytes))
+            return false;
+        payload.iv = payload.iv_bytes;
+    }
+    payload.version = version;
+    payload.offset = offset;
+    payload.length = static_cast<uint64_t>(size) - offset;
+    return true;
+}
+
+static ov_callbacks payloadCallbacks = {
+    [](void* ptr, size_t size, size_t nmemb, void* datasource) -> size_t {
+        auto* p = static_cast<PayloadFile*>(datasource);
+        uint64_t left = p->pos < p->length ? p->length - p->pos : 0;
+        size_t want = size * nmemb < left ? size * nmemb : static_cast<size_t>(left);
+        if (want == 0 || mogg_fseek64(p->file, static_cast<int64_t>(p->offset + p->pos), SEEK_SET) != 0)
+            return 0;
+        size_t got = fread(ptr, 1, want, p->file);
+        if (p->iv)
+            CtrCrypt(p->iv, static_cast<uint8_t*>(ptr), got, p->pos);
+        p->pos += got;
+        return got / size;
+    },
+    [](void* datasource, ogg_int64_t offset, int whence) -> int {
+        auto* p = static_cast<PayloadFile*>(datasource);
+        ogg_int64_t base = whence == SEEK_CUR ? static_cast<ogg_int64_t>(p->pos)
+            : whence == SEEK_END ? static_cast<ogg_int64_t>(p->length) : 0;
+        if (base + offset < 0)
+            return -1;
+        p->pos = static_cast<uint64_t>(base + offset);
+        return 0;
+    },
+    [](void*) -> int { return 0; },
+    [](void* datasource) -> long { return static_cast<long>(static_cast<PayloadFile*>(datasource)->pos); },
+};
+
+static bool TruncateFile(FILE* file, uint64_t length) {
+    if (fflush(file) != 0)
+        return false;
+#if defined(_WIN32)
+    return _chsize_s(_fileno(file), static_cast<__int64>(length)) == 0;
+#else
+    return ftruncate(fileno(file), static_cast<off_t>(length)) == 0;
+#endif
+}
+
+int makemogg_remap(const char* mogg_path, const makemogg_options* opts, makemogg_result* result) {
+    makemogg_options defaults;
+    if (!opts) {
+        makemogg_options_init(&defaults);
+        opts = &defaults;
+    }
+    FILE* file = fopen(mogg_path, "r+b");
+    if (!file) {
+        return 1;
+    }
+    std::unique_ptr<FILE, int (*)(FILE*)> closer(file, fclose);
+    PayloadFile payload;
+    if (!OpenPayload(file, payload, false)) {
+        return 3; // Not a mogg this library writes
+    }
+    bool encrypted = payload.iv != nullptr;
+    const uint8_t* iv = payload.iv;
+    uint64_t old_offset = payload.offset;
+    uint64_t size = payload.offset + payload.length;
+    Progress progress(opts);
+    progress.input_size = payload.length;
+    auto created = OggMap::Create(&payload, payloadCallbacks, MapOptionsFrom(opts, &progress));
+    if (std::holds_alternative<std::string>(created)) {
+        // Nothing has been written yet
+        return progress.cancelled ? 6 : 3;
+    }
+    auto& map = std::get<OggMap>(created);
+    FillResult(result, map.report);
+
+    // Version, Ogg data offset, the map and for 0xB the same IV as before
+    std::vector<uint8_t> header(8 + map.GetLength() + (encrypted ? sizeof(payload.iv_bytes) : 0));
+    store_le32(header.data(), payload.version);
+    store_le32(header.data() + 4, static_cast<uint32_t>(header.size()));
+    map.SerializeTo(header.data() + 8, map.GetLength());
+    if (encrypted)
+        std::memcpy(header.data() + header.size() - sizeof(payload.iv_bytes), iv, sizeof(payload.iv_bytes));
+
+    // Junk resync skipped before the first page is dropped. An encrypted
+    // payload then has to be re-encrypted at its new positions.
+    uint64_t skip = map.report.data_offset;
+    uint64_t length = payload.length - skip;
+    std::function<void(uint8_t*, size_t, uint64_t)> transform;
+    if (encrypted && skip) {
+        transform = [&](uint8_t* data, size_t n, uint64_t pos) {
+            CtrCrypt(iv, data, n, pos + skip);
+            CtrCrypt(iv, data, n, pos);
+        };
+    }
+    progress.output_size = length;
+    size_t block = opts->write_chunk_size ? opts->write_chunk_size : MoggWriter::DEFAULT_CHUNK_SIZE;
+    // Most remaps keep the map's size and only the header changes
+    int rc = ShiftPayload(file, old_offset + skip, header.size(), length, block, transform, progress);
+    if (rc != 0)
+        return rc;
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(header.data(), 1, header.size(), file) != header.size())
+        return 5;
+    if (header.size() + length < size && !TruncateFile(file, header.size() + length))
+        return 5;
+    return fclose(closer.release()) == 0 ? 0 : 5;
+}
+
+int makemogg_extract_clip(const char* input_path, uint64_t start_sample, uint64_t end_sample,
+                          const char* output_path, const makemogg_options* opts, makemogg_result* result) {
+    makemogg_options defaults;
+    if (!opts) {
+        makemogg_options_init(&defaults);
+        opts = &defaults;
+    }
+    if (end_sample <= start_sample || !OutputHashes::Valid(opts)) {
+        return 4;
+    }
+    std::vector<uint8_t> clip;
+    {
+        FILE* file = fopen(input_path, "rb");
+        if (!file) {
+            return 1;
+        }
+        std::unique_ptr<FILE, int (*)(FILE*)> closer(file, fclose);
+        PayloadFile payload;
+        if (!OpenPayload(file, payload, true)) {
+            return 3;
+        }
+        Progress progress(opts);
+        progress.input_size = payload.length;
+        auto extracted = ExtractOggClip(&payload, payloadCallbacks, start_sample, end_sample,
+                                        MapOptionsFrom(opts, &progress).scan);
+        if (std::holds_alternative<std::string>(extracted)) {
+            return progress.cancelled ? 6 : 3;
+        }
+        clip = std::move(std::get<std::vector<uint8_t>>(extracted));
+    }
+
+    auto created = OggMap::Create(clip.data(), clip.size(), MapOptionsFrom(opts, nullptr));
+    if (std::holds_alternative<std::string>(created)) {
+        return 3;
+    }
+    auto& map = std::get<OggMap>(created);
+    FillResult(result, map.report);
+    std::vector<uint8_t> header(8 + map.GetLength());
+    store_le32(header.data(), 0xA);
+    store_le32(header.data() + 4, static_cast<uint32_t>(header.size()));
+    map.SerializeTo(header.data() + 8, map.GetLength());
+
+    OutputFile outfile(output_path, opts->direct_io != 0);
+    if (!outfile.sink) {
+        return 2;
+    }
+    bool ok;
+    OutputHashes hashes(opts);
+    {
+        MoggWriter out(outfile.sink, outfile.callbacks, opts->write_chunk_size);
+        hashes.Attach(out);
+        ok = out.Write(header.data(), header.size()) && out.Write(clip.data(), clip.size()) && out.Flush();
+    }
+    int rc = outfile.Close() && ok ? 0 : 5;
+    hashes.Fill(result, rc);
+    return rc;
+}
+
+// Reads `length` bytes of the payload at `pos`. Returns the bytes read.
+static size_t ReadPayloadAt(PayloadFile& payload, uint64_t pos, uint8_t* dst, size_t length) {
+    payload.pos = pos;
+    return payloadCallbacks.read_func(dst, 1, length, &payload);
+}
+
+// Finds the last page of stream `serial` with a granule position, searching
+// back from the end of the payload through a window that starts small, as
+// the last page usually is, and grows. Only pages that fit in the window
+// and pass their CRC count, so stray "OggS" bytes in packet data are never
+// mistaken for one. Returns -1 if there is none.
+static int64_t LastGranule(PayloadFile& payload, int32_t serial) {
+    const size_t MAX_WINDOW = 2 * MAX_PAGE_SIZE;
+    std::vector<uint8_t> window(MAX_WINDOW);
+    size_t size = 0x4000;
+    uint64_t end = payload.length;
+    for (;;) {
+        uint64_t start = end > size ? end - size : 0;
+        size_t got = ReadPayloadAt(payload, start, window.data(), static_cast<size_t>(end - start));
+        for (size_t i = got; i-- > 0;) {
+            ogg_page_hdr hdr;
+            if (window[i] == 'O' && page_header_parse(window.data() + i, got - i, &hdr) == OK
+                && hdr.header_size + hdr.body_size <= got - i
+                && hdr.serial == serial && hdr.granule_pos != -1
+                && ogg_page_crc(window.data() + i, hdr.header_size + hdr.body_size)
+                    == static_cast<uint32_t>(hdr.checksum))
+                return hdr.granule_pos;
+        }
+        if (start == 0)
+            return -1;
+        // Overlap by a page, so one cut by the window's start is seen whole
+        if (start + MAX_PAGE_SIZE < end)
+            end = start + MAX_PAGE_SIZE;
+        size = size * 2 < MAX_WINDOW ? size * 2 : MAX_WINDOW;
+    }
+}
+
+int makemogg_probe(const char* path, makemogg_info* info) {
+    if (!info) {
+        return 4;
+    }
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 1;
+    }
+    std::unique_ptr<FILE, int (*)(FILE*)> closer(file, fclose);
+    PayloadFile payload;
+    if (!OpenPayload(file, payload, true)) {
         return 3;
     }
-    auto& map = std::get<OggMap>(result);
-    auto mapData = map.Serialize();
-    int oggVersion = 0xA;
-    int fileOffset = 8 + static_cast<int>(mapData.size());
-    outfile.write((char*)&oggVersion, sizeof(int));
-    outfile.write((char*)&fileOffset, sizeof(int));
-    outfile.write(mapData.data(), mapData.size());
-    // Copy the audio data
-    infile.clear();
-    infile.seekg(0);
-    size_t read = 0;
-    char copyBuf[8192];
-    do {
-        infile.read(copyBuf, 8192);
-        outfile.write(copyBuf, infile.gcount());
-    } while (infile.gcount() > 0);
+    // The identification header is alone on the first page. Junk in front
+    // of it, as resync would skip, is searched past.
+    std::vector<uint8_t> first(PAGE_HEADER_SIZE + 255);
+    size_t got = ReadPayloadAt(payload, 0, first.data(), first.size());
+    if (got < 4 || std::memcmp(first.data(), "OggS", 4) != 0) {
+        first.resize(0x10000);
+        got = ReadPayloadAt(payload, 0, first.data(), first.size());
+    }
+    ogg_page_hdr hdr;
+    vorbis_id_header id;
+    bool found = false;
+    for (size_t i = 0; i + PAGE_HEADER_SIZE <= got && !found; i++) {
+        if (first[i] != 'O' || page_header_parse(first.data() + i, got - i, &hdr) != OK
+            || hdr.page_segments == 0 || i + hdr.header_size + hdr.segment_table[0] > got)
+            continue;
+        vorbis_packet packet{ first.data() + i + hdr.header_size, 0, hdr.segment_table[0] };
+        found = vorbis_parse_id(&packet, &id) == OK;
+    }
+    if (!found) {
+        return 3;
+    }
+    int64_t total = LastGranule(payload, hdr.serial);
+    if (total < 0) {
+        return 3;
+    }
+    info->mogg_version = payload.version;
+    info->channels = id.audio_channels;
+    info->sample_rate = id.audio_sample_rate;
+    info->bitrate_nominal = id.bitrate_nominal;
+    info->total_samples = static_cast<uint64_t>(total);
     return 0;
 }
 
+struct makemogg_map {
+    std::vector<uint8_t> header; // Empty when viewing caller memory
+    OggMapView view;
+    size_t ogg_offset;
+};
+
+makemogg_map* makemogg_map_open(const char* mogg_path) {
+    // Only the header is read, so a small buffer will do
+    InputFile infile(mogg_path, 0x10000);
+    if (!infile.datasource) {
+        return nullptr;
+    }
+    auto* map = new makemogg_map();
+    if (!ReadMoggHeader(infile.datasource, infile.callbacks, map->header).empty()
+        || !map->view.ParseMogg(map->header.data(), map->header.size(), &map->ogg_offset)) {
+        delete map;
+        return nullptr;
+    }
+    return map;
+}
+
+makemogg_map* makemogg_map_view(const void* mogg_header, size_t length) {
+    auto* map = new makemogg_map();
+    if (!map->view.ParseMogg(mogg_header, length, &map->ogg_offset)) {
+        delete map;
+        return nullptr;
+    }
+    return map;
+}
+
+int makemogg_map_lookup(const makemogg_map* map, uint64_t sample, makemogg_seek_point* out) {
+    if (!map || !out) {
+        return 1;
+    }
+    auto entry = map->view.Lookup(sample);
+    out->file_offset = map->ogg_offset + entry.bytes;
+    out->ogg_offset = entry.bytes;
+    out->sample = entry.samples;
+    return 0;
+}
+
+void makemogg_map_free(makemogg_map* map) {
+    delete map;
+}
+
+struct makemogg_prefetch {
+    std::vector<uint8_t> table; // Empty when viewing caller memory
+    PrefetchView view;
+};
+
+makemogg_prefetch* makemogg_prefetch_open(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    auto* prefetch = new makemogg_prefetch();
+    prefetch->table.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (!prefetch->view.Parse(prefetch->table.data(), prefetch->table.size())) {
+        delete prefetch;
+        return nullptr;
+    }
+    return prefetch;
+}
+
+makemogg_prefetch* makemogg_prefetch_view(const void* table, size_t length) {
+    auto* prefetch = new makemogg_prefetch();
+    if (!prefetch->view.Parse(table, length)) {
+        delete prefetch;
+        return nullptr;
+    }
+    return prefetch;
+}
+
+int makemogg_prefetch_range(const makemogg_prefetch* table, uint64_t start_sample,
+                            uint64_t end_sample, makemogg_byte_range* out) {
+    PrefetchView::Range range;
+    if (!table || !out || !table->view.Lookup(start_sample, end_sample, range)) {
+        return 1;
+    }
+    out->offset = range.begin;
+    out->length = range.end - range.begin;
+    out->sample = range.sample;
+    out->max_packet = range.max_packet;
+    return 0;
+}
+
+void makemogg_prefetch_free(makemogg_prefetch* table) {
+    delete table;
+}
+
 // Dummy implementation for demonstration
 int makemogg_process(const char* input_path, const char* output_path) {
     // For now, just call the unencrypted mogg creator
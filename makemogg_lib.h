@@ -11,14 +11,336 @@
 #  define MAKEMOGG_API
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+#include "WriteCallbacks.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Ways to choose the IV of encrypted output (makemogg_options.iv_mode).
+enum {
+    // Random bytes from the OS. Every run gives different output.
+    MAKEMOGG_IV_RANDOM = 0,
+    // Derived from iv_seed, so the same seed gives the same output.
+    MAKEMOGG_IV_SEED = 1,
+    // Derived from a fingerprint of the input's Ogg pages, so identical
+    // inputs give byte-identical output.
+    MAKEMOGG_IV_INPUT_HASH = 2,
+};
+
+// Stages of a conversion, as reported to a progress callback.
+enum {
+    // Scanning the input to build the seek map. Positions are input bytes.
+    MAKEMOGG_STAGE_MAP = 0,
+    // Writing the mogg. Positions are output bytes.
+    MAKEMOGG_STAGE_WRITE = 1,
+};
+
+// Hashes of the output a conversion can compute as it writes it
+// (makemogg_options.hash, a combination of these).
+enum {
+    // XXH64 with seed 0: fast, for spotting corruption and duplicates.
+    MAKEMOGG_HASH_XXH64 = 1,
+    // SHA-256, for content addressing.
+    MAKEMOGG_HASH_SHA256 = 2,
+};
+
+// Called as a conversion advances, with the position reached in `stage` out
+// of `total`. Return nonzero to cancel the conversion.
+typedef int (*makemogg_progress_func)(void* user, int stage, uint64_t position, uint64_t total);
+
+// Conversion options. Initialize with makemogg_options_init before use.
+typedef struct makemogg_options {
+    // Nonzero to skip damaged pages and leading junk (such as ID3 tags)
+    // by searching for the next page with a valid CRC. Without it leading
+    // junk fails the conversion, and damage further on ends the map there.
+    int resync;
+    // Nonzero to check the CRC of every Ogg page. A mismatch fails the
+    // conversion unless resync is set, in which case the page is skipped.
+    int verify_crc;
+    // Samples between OggMap entries (default 20000) and the byte
+    // granularity of the seek points they are picked from (default 0x8000).
+    // Zero selects the default. Finer values give a bigger header but
+    // less audio to decode and discard after a seek.
+    uint32_t chunk_size;
+    uint32_t seek_increment;
+    // Nonzero to use the exact start of each page as a seek point,
+    // ignoring seek_increment.
+    int exact_seek_points;
+    // How encrypted output picks its IV, one of MAKEMOGG_IV_*, and the seed
+    // for MAKEMOGG_IV_SEED.
+    int iv_mode;
+    const void* iv_seed;
+    size_t iv_seed_length;
+    // Bytes handed to the output in each write, rounded up to a multiple of
+    // 4096 (default 1 MiB). Only the last write of a conversion is shorter.
+    size_t write_chunk_size;
+    // Optional progress callback, called about every progress_interval
+    // bytes of each stage (default 1 MiB) and once when writing finishes.
+    makemogg_progress_func progress;
+    void* progress_user;
+    uint64_t progress_interval;
+    // Nonzero (the default) to overlap reading, encryption and writing of
+    // encrypted output on separate threads. The input callbacks are then
+    // called from a worker thread; output callbacks and progress always run
+    // on the calling thread.
+    int pipeline;
+    // For makemogg_convert_batch: nonzero (the default) to use io_uring
+    // where the kernel allows it, and how many bytes of input it may hold
+    // in memory at once (default 256 MiB).
+    int io_uring;
+    size_t batch_memory;
+    // Nonzero to write output files around the page cache (O_DIRECT on
+    // Linux, F_NOCACHE on macOS) and drop the input's cached pages once it
+    // has been converted, so converting a large library doesn't evict
+    // everything else from memory. Falls back to ordinary writes where the
+    // filesystem doesn't support it. Ignored by the _cb functions, and
+    // makemogg_convert_batch then runs the jobs one at a time.
+    int direct_io;
+    // MAKEMOGG_HASH_* flags for the hashes of the output to return in the
+    // result, computed over each chunk as it is written, so the output
+    // never has to be read back. Honoured by the create, _cb and
+    // extract_clip functions and makemogg_convert_batch (which then
+    // doesn't use io_uring); the in-place functions ignore it.
+    int hash;
+    // If set, the create and _cb functions also write the output's prefetch
+    // table to this file, built in the same scan as its OggMap, for
+    // makemogg_prefetch_open. Encrypting an 0xA mogg reuses its map without
+    // a scan, so fails with 4 when this is set. Ignored by
+    // makemogg_convert_batch.
+    const char* prefetch_path;
+} makemogg_options;
+
+// Details about a finished conversion.
+typedef struct makemogg_result {
+    // Bytes of the input that were skipped by resync, and in how many places.
+    uint64_t skipped_bytes;
+    uint32_t skipped_regions;
+    // Pages that failed CRC verification.
+    uint32_t crc_failures;
+    // The MAKEMOGG_HASH_* flags of the hashes below that were computed,
+    // over the whole output as written. Zero if the conversion failed.
+    uint32_t hashes;
+    uint64_t xxh64;
+    uint8_t sha256[32];
+} makemogg_result;
+
+// Conversions return 0 on success, or one of these:
+//   1  the input could not be opened
+//   2  the output could not be opened
+//   3  the input could not be read or mapped
+//   4  invalid options or callbacks
+//   5  the output failed to accept a write
+//   6  cancelled by the progress callback; a partly written output file
+//      is removed
+
+// Fill opts with the defaults used by makemogg_create_unencrypted.
+MAKEMOGG_API void makemogg_options_init(makemogg_options* opts);
+
 // Create an unencrypted mogg file from input ogg
 // Returns 0 on success, nonzero on error
 MAKEMOGG_API int makemogg_create_unencrypted(const char* input_path, const char* output_path);
 
+// As makemogg_create_unencrypted, with options. opts and result may be NULL.
+MAKEMOGG_API int makemogg_create_unencrypted_ex(const char* input_path, const char* output_path,
+                                                const makemogg_options* opts, makemogg_result* result);
+
+// A mogg's seek map, loaded from its header.
+typedef struct makemogg_map makemogg_map;
+
+// Where to start decoding to reach a sample.
+typedef struct makemogg_seek_point {
+    // Offset in the mogg file, and the same point relative to the Ogg data.
+    uint64_t file_offset;
+    uint32_t ogg_offset;
+    // The sample the Ogg data at that point starts from.
+    uint32_t sample;
+} makemogg_seek_point;
+
+// Load the map from the header of an 0xA or 0xB mogg. Only the header is
+// read. Returns NULL on error; release with makemogg_map_free.
+MAKEMOGG_API makemogg_map* makemogg_map_open(const char* mogg_path);
+
+// Use the map in a mogg header that is already in memory, e.g. a mapped
+// file, without copying it. The memory must stay valid until
+// makemogg_map_free. Returns NULL if it isn't an 0xA or 0xB header.
+MAKEMOGG_API makemogg_map* makemogg_map_view(const void* mogg_header, size_t length);
+
+// Find the nearest seek point at or before `sample`.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_map_lookup(const makemogg_map* map, uint64_t sample, makemogg_seek_point* out);
+
+MAKEMOGG_API void makemogg_map_free(makemogg_map* map);
+
+// A mogg's prefetch table, written by a conversion with prefetch_path set:
+// for each map entry, where the pages needed to decode its chunk end and
+// the size of its largest packet. It lets a streaming player fetch exactly
+// the bytes a window of samples needs, in one range request.
+typedef struct makemogg_prefetch makemogg_prefetch;
+
+// A run of bytes of a mogg file.
+typedef struct makemogg_byte_range {
+    // Bytes [offset, offset + length) of the file.
+    uint64_t offset;
+    uint64_t length;
+    // The sample decoding from offset starts at, as makemogg_seek_point.
+    uint32_t sample;
+    // The largest packet among them, to size decode buffers by.
+    uint32_t max_packet;
+} makemogg_byte_range;
+
+// Load a prefetch table from a file. Returns NULL on error; release with
+// makemogg_prefetch_free.
+MAKEMOGG_API makemogg_prefetch* makemogg_prefetch_open(const char* path);
+
+// Use a prefetch table already in memory, without copying it. The memory
+// must stay valid until makemogg_prefetch_free. Returns NULL if it isn't
+// one.
+MAKEMOGG_API makemogg_prefetch* makemogg_prefetch_view(const void* table, size_t length);
+
+// Find the bytes needed to decode samples [start_sample, end_sample): from
+// the seek point for start_sample to the end of the page that completes
+// the last sample. Returns 0 on success, nonzero if the window is empty or
+// starts past the end of the mogg.
+MAKEMOGG_API int makemogg_prefetch_range(const makemogg_prefetch* table, uint64_t start_sample,
+                                         uint64_t end_sample, makemogg_byte_range* out);
+
+MAKEMOGG_API void makemogg_prefetch_free(makemogg_prefetch* table);
+
+// Create an encrypted (0xB) mogg from an input ogg, or from an unencrypted
+// (0xA) mogg. opts and result may be NULL.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_create_encrypted(const char* input_path, const char* output_path,
+                                           const makemogg_options* opts, makemogg_result* result);
+
+// Encrypts an unencrypted (0xA) mogg into an 0xB one in place: the payload
+// is moved up past the larger header and encrypted as it goes, so only one
+// copy of the file is ever on disk. Uses the IV and write_chunk_size options;
+// write_chunk_size is also the size of each block moved. Progress is
+// reported as MAKEMOGG_STAGE_WRITE, but the move can't be cancelled. A
+// failure partway leaves the file unreadable, though it keeps its 0xA
+// header. opts and result may be NULL.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_encrypt_in_place(const char* mogg_path, const makemogg_options* opts,
+                                           makemogg_result* result);
+
+// Rebuilds the map of an existing 0xA or 0xB mogg in place, e.g. with a new
+// chunk_size, or to repair a bad one. The Ogg data is scanned (decrypted on
+// the fly for 0xB) using the map options, and only the header is rewritten
+// when the new map is the same size. Otherwise the payload is moved once,
+// as with makemogg_encrypt_in_place; cancelling is only possible while
+// scanning, before anything is written. opts and result may be NULL.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_remap(const char* mogg_path, const makemogg_options* opts, makemogg_result* result);
+
+// Cuts samples [start_sample, end_sample) out of an ogg, or an 0xA or 0xB
+// mogg, into a new unencrypted (0xA) mogg with its own map, without
+// decoding any audio: the Vorbis headers and the packets covering the
+// range are copied onto new pages, and the decoder is told through their
+// granule positions to trim them to exactly the range. Samples are counted
+// as in the map. The input is scanned up to end_sample; an end past the
+// end of the stream stops there. A clip must be longer than one Vorbis
+// block (up to a few thousand samples), so one starting inside the
+// stream's last block fails. opts and result may be NULL.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_extract_clip(const char* input_path, uint64_t start_sample, uint64_t end_sample,
+                                       const char* output_path, const makemogg_options* opts,
+                                       makemogg_result* result);
+
+// What makemogg_probe found.
+typedef struct makemogg_info {
+    // 0xA or 0xB for a mogg, 0 for a plain ogg.
+    uint32_t mogg_version;
+    uint32_t channels;
+    uint32_t sample_rate;
+    // Bits per second, as the encoder declared it; 0 if it didn't.
+    int32_t bitrate_nominal;
+    // Samples per channel, from the last page's granule position.
+    uint64_t total_samples;
+} makemogg_info;
+
+// Reads the format and length of an ogg, or an 0xA or 0xB mogg, from its
+// first page and the last pages of the file, without scanning the rest.
+// Other logical streams multiplexed in are ignored; in a chained file only
+// the first stream is described.
+// Returns 0 on success, nonzero on error
+MAKEMOGG_API int makemogg_probe(const char* path, makemogg_info* info);
+
+// As makemogg_create_unencrypted_ex and makemogg_create_encrypted, reading
+// the input through ov_callbacks (read, seek and tell are required) and
+// writing the mogg through output_callbacks, so it can go to a socket or
+// memory instead of a file. The input is read from its start and is not
+// closed. Output is written strictly in order; its seek and tell are unused.
+MAKEMOGG_API int makemogg_create_unencrypted_cb(void* input, ov_callbacks input_callbacks,
+                                                void* output, mogg_write_callbacks output_callbacks,
+                                                const makemogg_options* opts, makemogg_result* result);
+MAKEMOGG_API int makemogg_create_encrypted_cb(void* input, ov_callbacks input_callbacks,
+                                              void* output, mogg_write_callbacks output_callbacks,
+                                              const makemogg_options* opts, makemogg_result* result);
+
+// One file of a makemogg_convert_batch call.
+typedef struct makemogg_job {
+    const char* input_path;
+    const char* output_path;
+    // Nonzero to make an encrypted mogg, as makemogg_create_encrypted.
+    int encrypt;
+    // Set by the batch: what the single-file call would have returned,
+    // and its result.
+    int status;
+    makemogg_result result;
+} makemogg_job;
+
+// Converts many files. On Linux with io_uring, one thread keeps the reads
+// and writes of many files in flight together, each file being read whole
+// into memory; elsewhere, and for files bigger than batch_memory, the jobs
+// run one at a time. Progress callbacks are only made for the latter.
+// Returns the number of jobs that failed.
+MAKEMOGG_API int makemogg_convert_batch(makemogg_job* jobs, size_t count, const makemogg_options* opts);
+
+// A job queued with makemogg_submit.
+typedef struct makemogg_task makemogg_task;
+
+// Called on a library thread when a submitted job has finished, after its
+// status and result are set but before the task counts as done, so it
+// must not wait on its own task. The thread runs no other job until it
+// returns.
+typedef void (*makemogg_complete_func)(void* user, makemogg_job* job);
+
+// Queues a conversion and returns at once, for callers that can't block a
+// thread on one (such as an event loop). Jobs run on the library's own
+// threads, one per core, started on the first call. Queueing is lock-free,
+// so any number of threads can submit at once without waiting on each
+// other. `opts` is copied (null for defaults, with pipeline off since the
+// threads are busy with other jobs), but `job`, its paths, any iv_seed and
+// any prefetch_path must stay valid until the job has finished. Then
+// on_complete, if set, is called with `user`, and once it has returned
+// the task is done and the completion fd is signalled. Returns a handle to
+// free with makemogg_task_free, or null if out of memory.
+MAKEMOGG_API makemogg_task* makemogg_submit(makemogg_job* job, const makemogg_options* opts,
+                                            makemogg_complete_func on_complete, void* user);
+
+// Returns nonzero once the task's job has finished and its on_complete
+// has returned.
+MAKEMOGG_API int makemogg_task_done(const makemogg_task* task);
+
+// Waits for the task to be done, as makemogg_task_done, and returns its
+// job's status.
+MAKEMOGG_API int makemogg_task_wait(makemogg_task* task);
+
+// Frees a task handle. A job still queued or running carries on, and still
+// completes as above.
+MAKEMOGG_API void makemogg_task_free(makemogg_task* task);
+
+// Returns a descriptor that becomes readable when submitted jobs finish,
+// for an event loop to watch: an eventfd on Linux, the read end of a pipe
+// on other POSIX systems. Read it until it would block, then check the
+// outstanding tasks with makemogg_task_done. It is opened on the first
+// call, shared by all callers and only signalled from then on. Returns -1
+// on Windows or if it can't be opened.
+MAKEMOGG_API int makemogg_completion_fd(void);
+
 // Example API: process a mogg file (dummy, for compatibility)
 // Returns 0 on success, nonzero on error
 MAKEMOGG_API int makemogg_process(const char* input_path, const char* output_path);
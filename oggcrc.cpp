@@ -0,0 +1,167 @@
+#include "oggcrc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OGGCRC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint32_t POLY = 0x04C11DB7u;
+
+// Slicing-by-8 tables: t[0] is the classic byte table, and t[k][b] is the
+// CRC contribution of byte b followed by k zero bytes.
+struct CrcTables {
+    uint32_t t[8][256];
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t r = i << 24;
+            for (int j = 0; j < 8; j++)
+                r = (r & 0x80000000u) ? (r << 1) ^ POLY : (r << 1);
+            t[0][i] = r;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int i = 0; i < 256; i++)
+                t[k][i] = (t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 24];
+        }
+    }
+};
+
+const CrcTables tables;
+
+inline uint32_t load_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint32_t crc_slice8(uint32_t crc, const uint8_t* data, size_t len)
+{
+    const uint32_t (*t)[256] = tables.t;
+    while (len >= 8) {
+        uint32_t a = crc ^ load_be32(data);
+        uint32_t b = load_be32(data + 4);
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff]
+            ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^ t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+        data += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    return crc;
+}
+
+#ifdef OGGCRC_X86
+// x^n mod P, used for the folding constants.
+uint32_t xpow_mod(unsigned n)
+{
+    uint32_t r = 1;
+    while (n--)
+        r = (r & 0x80000000u) ? (r << 1) ^ POLY : (r << 1);
+    return r;
+}
+
+// Carry-less multiply folding. Blocks are byte-reversed on load so that a
+// 128-bit lane holds 16 message bytes as a polynomial with the first bit
+// at x^127. A lane X = H*x^64 + L advanced by n bits is congruent to
+// H*(x^(n+64) mod P) + L*(x^n mod P), which still fits in 128 bits, so the
+// stream is folded 64 bytes at a time over four lanes and then the lanes
+// are folded into one. The last 128 bits and any tail go through the
+// table code, which also does the final reduction.
+struct FoldConstants {
+    __m128i k512;
+    __m128i k128;
+    FoldConstants()
+        : k512(_mm_set_epi64x(xpow_mod(512 + 64), xpow_mod(512)))
+        , k128(_mm_set_epi64x(xpow_mod(128 + 64), xpow_mod(128))) {}
+};
+
+__attribute__((target("pclmul,ssse3,sse4.1")))
+inline __m128i fold(__m128i x, __m128i k, __m128i next)
+{
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+__attribute__((target("pclmul,ssse3,sse4.1")))
+inline __m128i load_reversed(const uint8_t* p, __m128i reverse)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), reverse);
+}
+
+__attribute__((target("pclmul,ssse3,sse4.1")))
+uint32_t crc_pclmul(uint32_t crc, const uint8_t* data, size_t len)
+{
+    if (len < 128)
+        return crc_slice8(crc, data, len);
+
+    static const FoldConstants k;
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    // Feeding the running CRC in means XORing it over the first 32 bits.
+    __m128i x0 = _mm_xor_si128(load_reversed(data, reverse), _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+    __m128i x1 = load_reversed(data + 16, reverse);
+    __m128i x2 = load_reversed(data + 32, reverse);
+    __m128i x3 = load_reversed(data + 48, reverse);
+    data += 64;
+    len -= 64;
+    while (len >= 64) {
+        x0 = fold(x0, k.k512, load_reversed(data, reverse));
+        x1 = fold(x1, k.k512, load_reversed(data + 16, reverse));
+        x2 = fold(x2, k.k512, load_reversed(data + 32, reverse));
+        x3 = fold(x3, k.k512, load_reversed(data + 48, reverse));
+        data += 64;
+        len -= 64;
+    }
+    x1 = fold(x0, k.k128, x1);
+    x2 = fold(x1, k.k128, x2);
+    x3 = fold(x2, k.k128, x3);
+    while (len >= 16) {
+        x3 = fold(x3, k.k128, load_reversed(data, reverse));
+        data += 16;
+        len -= 16;
+    }
+
+    alignas(16) uint8_t last[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(last), _mm_shuffle_epi8(x3, reverse));
+    crc = crc_slice8(0, last, 16);
+    return crc_slice8(crc, data, len);
+}
+#endif
+
+typedef uint32_t(*crc_fn)(uint32_t, const uint8_t*, size_t);
+
+crc_fn select_crc(bool hardware)
+{
+#ifdef OGGCRC_X86
+    __builtin_cpu_init();
+    if (hardware && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        return crc_pclmul;
+#endif
+    return crc_slice8;
+}
+
+crc_fn crc_impl = select_crc(true);
+
+}
+
+uint32_t ogg_crc_update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    return crc_impl(crc, data, len);
+}
+
+uint32_t ogg_page_crc(const uint8_t* page, size_t len)
+{
+    static const uint8_t zero[4] = { 0, 0, 0, 0 };
+    if (len < 26)
+        return ogg_crc_update(0, page, len);
+    uint32_t crc = crc_slice8(0, page, 22);
+    crc = crc_slice8(crc, zero, 4);
+    return ogg_crc_update(crc, page + 26, len - 26);
+}
+
+bool ogg_crc_use_hardware(bool enable)
+{
+    crc_impl = select_crc(enable);
+    return crc_impl != crc_slice8;
+}
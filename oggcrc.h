@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// CRC32 as used by Ogg pages: polynomial 0x04C11DB7, MSB-first, initial
+// value 0 and no final XOR. The page checksum is computed over the whole
+// page with the checksum field set to zero.
+
+// Continue a checksum over `len` more bytes.
+uint32_t ogg_crc_update(uint32_t crc, const uint8_t* data, size_t len);
+
+// Checksum of a complete page as it appears on disk, treating bytes 22..25
+// (the stored checksum) as zero.
+uint32_t ogg_page_crc(const uint8_t* page, size_t len);
+
+// Turns the PCLMUL path off, so checksums use slicing-by-8, or back on if
+// the CPU has it. For tests, which check both; not to be called while
+// other threads checksum. Returns whether PCLMUL is now used.
+bool ogg_crc_use_hardware(bool enable);
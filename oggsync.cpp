@@ -0,0 +1,101 @@
+#include "oggsync.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OGGSYNC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool is_capture(const uint8_t* p)
+{
+    return p[0] == 'O' && p[1] == 'g' && p[2] == 'g' && p[3] == 'S';
+}
+
+size_t find_scalar(const uint8_t* buf, size_t len, size_t from)
+{
+    if (len < 4)
+        return len;
+    for (size_t i = from; i <= len - 4; i++) {
+        const void* o = memchr(buf + i, 'O', len - 3 - i);
+        if (!o)
+            break;
+        i = static_cast<const uint8_t*>(o) - buf;
+        if (is_capture(buf + i))
+            return i;
+    }
+    return len;
+}
+
+#ifdef OGGSYNC_X86
+// Each vector step compares 16 (or 32) candidate start positions at once:
+// the four byte lanes of the pattern are matched against four loads offset
+// by one byte, and the masks ANDed together.
+__attribute__((target("sse2")))
+size_t find_sse2(const uint8_t* buf, size_t len)
+{
+    size_t i = 0;
+    if (len >= 19) {
+        const __m128i o = _mm_set1_epi8('O');
+        const __m128i g = _mm_set1_epi8('g');
+        const __m128i s = _mm_set1_epi8('S');
+        for (; i + 19 <= len; i += 16) {
+            __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i)), o);
+            __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 1)), g);
+            __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 2)), g);
+            __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 3)), s);
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(buf, len, i);
+}
+
+__attribute__((target("avx2")))
+size_t find_avx2(const uint8_t* buf, size_t len)
+{
+    size_t i = 0;
+    if (len >= 35) {
+        const __m256i o = _mm256_set1_epi8('O');
+        const __m256i g = _mm256_set1_epi8('g');
+        const __m256i s = _mm256_set1_epi8('S');
+        for (; i + 35 <= len; i += 32) {
+            __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i)), o);
+            __m256i m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 1)), g);
+            __m256i m2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 2)), g);
+            __m256i m3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 3)), s);
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_and_si256(m0, m1), _mm256_and_si256(m2, m3))));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+    }
+    return find_sse2(buf + i, len - i) + i;
+}
+#endif
+
+typedef size_t(*find_fn)(const uint8_t*, size_t);
+
+find_fn select_find()
+{
+#ifdef OGGSYNC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return find_sse2;
+#endif
+    return [](const uint8_t* buf, size_t len) { return find_scalar(buf, len, 0); };
+}
+
+const find_fn find_impl = select_find();
+
+}
+
+size_t ogg_find_capture(const uint8_t* buf, size_t len)
+{
+    return find_impl(buf, len);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Returns the offset of the first "OggS" capture pattern that lies entirely
+// within buf[0, len), or len if there is none. Uses AVX2 or SSE2 when the
+// CPU supports them.
+size_t ogg_find_capture(const uint8_t* buf, size_t len);
@@ -1,4 +1,7 @@
 #include "oggvorbis.h"
+#include "oggcrc.h"
+#include "oggsync.h"
+#include "OggSource.h"
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -38,42 +41,184 @@ const char* str_of_err(err e)
     case INVALID_FLOOR: return "Invalid floor";
     case FRAMING_ERROR: return "Framing error";
     case INVALID_RESIDUES: return "Invalid residues";
+    case BAD_CHECKSUM: return "Page checksum mismatch";
+    case CANCELLED: return "Cancelled";
+    case FOREIGN_PAGE: return "Page of another logical stream";
+    case CHAIN_BOUNDARY: return "Start of a chained stream";
     }
     return "Error handling meta-error: invalid error code";
 }
 
-err page_header_read(vorbis_state* s, ogg_page_hdr* hdr)
+uint64_t page_digest_add(uint64_t digest, uint32_t checksum, uint32_t length)
+{
+    const uint32_t words[2] = { checksum, length };
+    for (uint32_t w : words)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            digest ^= (w >> (i * 8)) & 0xff;
+            digest *= 0x100000001b3ull;
+        }
+    }
+    return digest;
+}
+
+err page_header_parse(const byte* buf, size_t got, ogg_page_hdr* hdr)
 {
-    void* fi = s->datasource;
-    hdr->start_pos = s->callbacks.tell_func(fi);
     hdr->capture_pattern[0] = 0;
-    if (s->callbacks.read_func(hdr->capture_pattern, 4, 1, fi) != 1)
+    if (got < 4)
         return READ_ERROR;
+    memcpy(hdr->capture_pattern, buf, 4);
     if (hdr->capture_pattern[0] != 'O'
         || hdr->capture_pattern[1] != 'g'
         || hdr->capture_pattern[2] != 'g'
         || hdr->capture_pattern[3] != 'S') {
         return NO_CAPTURE_PATTERN;
     }
-    if (s->callbacks.read_func(&hdr->stream_structure_version, 1, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->header_type_flag, 1, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->granule_pos, 8, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->serial, 4, 1, fi) != 1)
+    if (got < PAGE_HEADER_SIZE)
         return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->seq_no, 4, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->checksum, 4, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(&hdr->page_segments, 1, 1, fi) != 1)
-        return READ_ERROR;
-    if (s->callbacks.read_func(hdr->segment_table, 1, hdr->page_segments, fi) != hdr->page_segments)
+    hdr->stream_structure_version = buf[4];
+    hdr->header_type_flag = buf[5];
+    memcpy(&hdr->granule_pos, buf + 6, 8);
+    memcpy(&hdr->serial, buf + 14, 4);
+    memcpy(&hdr->seq_no, buf + 18, 4);
+    memcpy(&hdr->checksum, buf + 22, 4);
+    hdr->page_segments = buf[26];
+    if (got < PAGE_HEADER_SIZE + hdr->page_segments)
         return READ_ERROR;
+    memcpy(hdr->segment_table, buf + PAGE_HEADER_SIZE, hdr->page_segments);
+    hdr->header_size = PAGE_HEADER_SIZE + hdr->page_segments;
+    hdr->body_size = 0;
+    for (int i = 0; i < hdr->page_segments; i++)
+        hdr->body_size += hdr->segment_table[i];
     return OK;
 }
 
+// True for a page of a logical stream other than the one being scanned,
+// which needn't be read at all. BOS pages are kept, as one may begin the
+// next stream of a chain.
+static bool page_is_foreign(vorbis_state* s, ogg_page_hdr* hdr)
+{
+    return s->serial_locked && hdr->serial != s->serial && !(hdr->header_type_flag & 0x02);
+}
+
+// Reads a whole page into hdr and s->page, or steps over the body of a
+// foreign page and returns FOREIGN_PAGE. Sources that can peek are
+// scanned in place; others are copied into page_buf. A truncated body is
+// zero-filled, so the packets before the cut still get counted.
+template <class Source>
+err page_read(vorbis_state* s, Source& src, ogg_page_hdr* hdr)
+{
+    err e;
+    hdr->start_pos = static_cast<long>(src.Tell());
+    size_t got;
+    const byte* p = src.Peek(PAGE_HEADER_SIZE + 255, &got);
+    if (p)
+    {
+        if ((e = page_header_parse(p, got, hdr)) != OK)
+            return e;
+        size_t page_size = hdr->header_size + hdr->body_size;
+        if (page_is_foreign(s, hdr))
+        {
+            src.Skip(page_size);
+            return FOREIGN_PAGE;
+        }
+        p = src.Peek(page_size, &got);
+        if (p && got == page_size)
+        {
+            s->page = p;
+            src.Skip(page_size);
+            return OK;
+        }
+        if (p)
+        {
+            memcpy(s->page_buf, p, got);
+            src.Skip(got);
+        }
+        else
+        {
+            got = src.Read(s->page_buf, page_size);
+        }
+    }
+    else
+    {
+        byte* buf = s->page_buf;
+        got = src.Read(buf, PAGE_HEADER_SIZE);
+        if (got == PAGE_HEADER_SIZE)
+            got += src.Read(buf + PAGE_HEADER_SIZE, buf[26]);
+        if ((e = page_header_parse(buf, got, hdr)) != OK)
+            return e;
+        if (page_is_foreign(s, hdr))
+        {
+            src.Seek(static_cast<uint64_t>(hdr->start_pos) + hdr->header_size + hdr->body_size);
+            return FOREIGN_PAGE;
+        }
+        got += src.Read(buf + hdr->header_size, hdr->body_size);
+    }
+    size_t page_size = hdr->header_size + hdr->body_size;
+    if (got < page_size)
+        memset(s->page_buf + got, 0, page_size - got);
+    s->page = s->page_buf;
+    return OK;
+}
+
+bool page_crc_valid(vorbis_state* s, ogg_page_hdr* hdr)
+{
+    return ogg_page_crc(s->page, hdr->header_size + hdr->body_size)
+        == static_cast<uint32_t>(hdr->checksum);
+}
+
+constexpr size_t RESYNC_WINDOW = 0x10000;
+
+// Searches forward from just past cur_page_start for the next capture
+// pattern that begins a page with a valid CRC. On success cur_page holds
+// that page and the skipped bytes are added to the state's counters.
+template <class Source>
+err page_resync(vorbis_state* s, Source& src)
+{
+    if (!s->scan_buf) {
+        s->scan_buf = static_cast<byte*>(malloc(RESYNC_WINDOW));
+        if (!s->scan_buf)
+            return MALLOC;
+    }
+    size_t origin = s->cur_page_start;
+    size_t base = origin + 1;
+    for (;;)
+    {
+        if (!src.Seek(base))
+            return READ_ERROR;
+        size_t n = src.Read(s->scan_buf, RESYNC_WINDOW);
+        size_t off = 0;
+        while (off + 4 <= n)
+        {
+            off += ogg_find_capture(s->scan_buf + off, n - off);
+            if (off + 4 > n)
+                break;
+            size_t candidate = base + off;
+            if (src.Seek(candidate)
+                && page_read(s, src, &s->cur_page) == OK
+                && page_crc_valid(s, &s->cur_page))
+            {
+                s->cur_page_start = candidate;
+                s->skipped_bytes += candidate - origin;
+                s->skipped_regions++;
+                s->resynced = true;
+                return OK;
+            }
+            off++;
+        }
+        if (n < RESYNC_WINDOW)
+        {
+            // Nothing but junk until EOF; report it and end the stream.
+            s->skipped_bytes += base + n - origin;
+            s->skipped_regions++;
+            return READ_ERROR;
+        }
+        // Keep the last 3 bytes so a pattern straddling windows is found.
+        base += n - 3;
+    }
+}
+
 void page_header_print(ogg_page_hdr* hdr)
 {
     printf("Capture pattern: %c%c%c%c\n", hdr->capture_pattern[0], hdr->capture_pattern[1], hdr->capture_pattern[2], hdr->capture_pattern[3]);
@@ -115,49 +260,119 @@ uint64_t vorbis_read_bits(vorbis_packet* s, size_t count, bool d = false)
     return ret;
 }
 
-err vorbis_read_page(vorbis_state* s)
+template <class Source>
+err vorbis_read_page(vorbis_state* s, Source& src)
 {
     err e;
-    s->cur_page_start = s->callbacks.tell_func(s->datasource);
-    if ((e = page_header_read(s, &s->cur_page)) != 0)
-        return e;
-    s->file_pos = s->callbacks.tell_func(s->datasource);
+    s->resynced = false;
+    for (;;)
+    {
+        s->cur_page_start = static_cast<size_t>(src.Tell());
+        if ((e = page_read(s, src, &s->cur_page)) == FOREIGN_PAGE)
+            continue;
+        if (e == OK)
+        {
+            // The page is still hot in cache, so checking it here is nearly free.
+            if (s->options.verify_crc && !page_crc_valid(s, &s->cur_page))
+            {
+                s->crc_failures++;
+                e = BAD_CHECKSUM;
+            }
+        }
+        if ((e == NO_CAPTURE_PATTERN || e == BAD_CHECKSUM) && s->options.resync)
+            e = page_resync(s, src);
+        if (e != OK)
+            return e;
+        // A BOS page of another stream: the next link of a chain once ours
+        // has ended, and otherwise a stray to pass over like any other
+        if (s->serial_locked && s->cur_page.serial != s->serial && !s->stream_ended)
+            continue;
+        break;
+    }
+    if (s->options.progress && s->cur_page_start >= s->next_progress)
+    {
+        s->next_progress = s->cur_page_start + s->options.progress_interval;
+        if (s->options.progress(s->options.progress_user, s->cur_page_start) != 0)
+            return CANCELLED;
+    }
+    s->page_digest = page_digest_add(s->page_digest, s->cur_page.checksum,
+        static_cast<uint32_t>(s->cur_page.header_size + s->cur_page.body_size));
+    s->file_pos = s->cur_page_start + s->cur_page.header_size;
+    s->body_pos = s->cur_page.header_size;
     s->next_segment = 0;
+    if (s->serial_locked && s->cur_page.serial != s->serial)
+        return CHAIN_BOUNDARY;
+    if (s->cur_page.granule_pos != -1)
+        s->last_granule = s->cur_page.granule_pos;
+    if (s->cur_page.header_type_flag & 0x04)
+        s->stream_ended = true;
+    return OK;
+}
+
+// After a resync the first segments of a continued page belong to a packet
+// whose start was lost. Skip them, reading on if the whole page is one.
+template <class Source>
+err vorbis_skip_partial_packet(vorbis_state* s, Source& src)
+{
+    err e;
+    while (s->cur_page.header_type_flag & 1)
+    {
+        byte segment_length = 255;
+        while (s->next_segment < s->cur_page.page_segments && segment_length == 255)
+        {
+            segment_length = s->cur_page.segment_table[s->next_segment++];
+            s->body_pos += segment_length;
+            s->file_pos += segment_length;
+        }
+        if (segment_length < 255)
+            break;
+        if ((e = vorbis_read_page(s, src)) != OK)
+            return e;
+    }
     return OK;
 }
 
-err vorbis_read_packet(vorbis_state* s)
+template <class Source>
+err vorbis_read_packet(vorbis_state* s, Source& src)
 {
     err e;
     size_t packet_size = 0;
-    size_t packet_read = 0;
     byte segment_length;
-    do
+    for (;;)
     {
         if (s->next_segment >= s->cur_page.page_segments)
         {
-            if (packet_size - packet_read > 0)
+            if ((e = vorbis_read_page(s, src)) != OK)
+                return e;
+            if (s->resynced)
             {
-                s->callbacks.read_func(s->cur_packet.buf + packet_read, 1, packet_size - packet_read, s->datasource);
-                packet_read = packet_size;
+                // Whatever was gathered before the gap is unusable.
+                packet_size = 0;
+                if ((e = vorbis_skip_partial_packet(s, src)) != OK)
+                    return e;
+                if (s->data_offset != s->cur_page_start)
+                {
+                    s->last_bs = 0;
+                    s->anchor_pending = true;
+                }
+                s->resynced = false;
+                continue;
             }
-            if ((e = vorbis_read_page(s)) != OK)
-                return e;
         }
         segment_length = s->cur_page.segment_table[s->next_segment++];
         if (packet_size == 0) {
             s->cur_packet_start = s->file_pos;
         }
-        packet_size += segment_length;
-        s->file_pos += segment_length;
-        if (packet_size > MAX_PACKET_SIZE)
+        if (packet_size + segment_length > MAX_PACKET_SIZE)
         {
             return PACKET_TOO_LARGE;
         }
-    } while (segment_length == 255);
-    if (packet_size - packet_read > 0)
-    {
-        s->callbacks.read_func(s->cur_packet.buf + packet_read, 1, packet_size - packet_read, s->datasource);
+        memcpy(s->cur_packet.buf + packet_size, s->page + s->body_pos, segment_length);
+        s->body_pos += segment_length;
+        packet_size += segment_length;
+        s->file_pos += segment_length;
+        if (segment_length != 255)
+            break;
     }
 
     s->cur_packet.size = packet_size;
@@ -165,25 +380,47 @@ err vorbis_read_packet(vorbis_state* s)
     return OK;
 }
 
+// True if no packet after the current one completes on cur_page, so the
+// page's granule position is the sample count at the end of this packet.
+bool vorbis_packet_ends_page(vorbis_state* s)
+{
+    for (size_t i = s->next_segment; i < s->cur_page.page_segments; i++)
+    {
+        if (s->cur_page.segment_table[i] != 255)
+            return false;
+    }
+    return true;
+}
+
+// Frees the codebooks of the last setup header read. Slots past a failed
+// parse are still null, since the state is calloc'd.
+static void vorbis_free_codebooks(vorbis_state* s)
+{
+    for (auto& c : s->setup.codebooks)
+    {
+        free(c.entries);
+        c.entries = nullptr;
+    }
+}
+
 void vorbis_free(vorbis_state* s)
 {
     if (s == nullptr) return;
+    vorbis_free_codebooks(s);
     if (s->cur_packet.buf) {
         free(s->cur_packet.buf);
     }
+    free(s->page_buf);
+    free(s->scan_buf);
     free(s);
 }
 
 const uint64_t VORBIS_ID = 0x736962726f76ull;
 
-err vorbis_read_id(vorbis_state* s)
+err vorbis_parse_id(vorbis_packet* p, vorbis_id_header* id)
 {
-    err e;
-    if ((e = vorbis_read_packet(s)) != OK)
-        return e;
-    if (s->cur_packet.size != 30)
+    if (p->size != 30)
         return NOT_VORBIS;
-    vorbis_packet* p = &s->cur_packet;
     if (vorbis_read_bits(p, 8) != 1)
         return NOT_VORBIS;
     uint64_t v;
@@ -191,37 +428,43 @@ err vorbis_read_id(vorbis_state* s)
     {
         return NOT_VORBIS;
     }
-    s->id.vorbis_version = vorbis_read_bits(p, 32);
-    s->id.audio_channels = vorbis_read_bits(p, 8);
-    s->id.audio_sample_rate = vorbis_read_bits(p, 32);
-    s->id.bitrate_maximum = vorbis_read_bits(p, 32);
-    s->id.bitrate_nominal = vorbis_read_bits(p, 32);
-    s->id.bitrate_minimum = vorbis_read_bits(p, 32);
-    s->id.blocksize_0 = vorbis_read_bits(p, 4);
-    s->id.blocksize_1 = vorbis_read_bits(p, 4);
-    s->id.framing_flag = vorbis_read_bits(p, 1);
-
-    if (s->id.vorbis_version != 0)
+    id->vorbis_version = vorbis_read_bits(p, 32);
+    id->audio_channels = vorbis_read_bits(p, 8);
+    id->audio_sample_rate = vorbis_read_bits(p, 32);
+    id->bitrate_maximum = vorbis_read_bits(p, 32);
+    id->bitrate_nominal = vorbis_read_bits(p, 32);
+    id->bitrate_minimum = vorbis_read_bits(p, 32);
+    id->blocksize_0 = vorbis_read_bits(p, 4);
+    id->blocksize_1 = vorbis_read_bits(p, 4);
+    id->framing_flag = vorbis_read_bits(p, 1);
+
+    if (id->vorbis_version != 0)
         return INVALID_VERSION;
-    if (s->id.audio_channels == 0)
+    if (id->audio_channels == 0)
         return INVALID_CHANNELS;
-    if (s->id.audio_sample_rate == 0)
+    if (id->audio_sample_rate == 0)
         return INVALID_SAMPLE_RATE;
-    if (s->id.blocksize_0 < 6 || s->id.blocksize_0 > 13)
+    if (id->blocksize_0 < 6 || id->blocksize_0 > 13)
         return INVALID_BLOCKSIZE_0;
-    if (s->id.blocksize_1 < 6 || s->id.blocksize_1 > 13)
+    if (id->blocksize_1 < 6 || id->blocksize_1 > 13)
         return INVALID_BLOCKSIZE_1;
-    if (s->id.blocksize_0 > s->id.blocksize_1)
+    if (id->blocksize_0 > id->blocksize_1)
         return INVALID_BLOCKSIZE_0;
     return OK;
 }
 
+// Parses the identification header in cur_packet.
+err vorbis_read_id(vorbis_state* s)
+{
+    return vorbis_parse_id(&s->cur_packet, &s->id);
+}
+
+// Parses the setup header in cur_packet.
 err vorbis_read_setup(vorbis_state *s)
 {
-    err e;
-    if ((e = vorbis_read_packet(s)) != OK)
-        return e;
     vorbis_packet* p = &s->cur_packet;
+    // Each link of a chain has its own setup header
+    vorbis_free_codebooks(s);
     if (vorbis_read_bits(p, 8) != 5)
     {
         return INVALID_DATA;
@@ -494,7 +737,41 @@ err vorbis_read_setup(vorbis_state *s)
     return OK;
 }
 
-err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks)
+// Reads the three Vorbis headers of a stream, starting from the BOS page in
+// cur_page, and locks the scan onto that stream. BOS pages of other
+// logical streams that come first, such as Skeleton's, are skipped.
+template <class Source>
+err vorbis_read_headers(vorbis_state* s, Source& src)
+{
+    err e;
+    s->serial_locked = false;
+    for (;;)
+    {
+        if ((e = vorbis_read_packet(s, src)) != OK)
+            return e;
+        if ((e = vorbis_read_id(s)) == OK)
+            break;
+        if (e != NOT_VORBIS || !(s->cur_page.header_type_flag & 0x02))
+            return e;
+        s->next_segment = s->cur_page.page_segments;
+    }
+    s->serial = s->cur_page.serial;
+    s->serial_locked = true;
+    s->stream_ended = false;
+    s->last_granule = 0;
+
+    if ((e = vorbis_read_packet(s, src)) != OK)
+        return e;
+    if (vorbis_read_bits(&s->cur_packet, 8) != 3)
+        return INVALID_DATA;
+
+    if ((e = vorbis_read_packet(s, src)) != OK)
+        return e;
+    return vorbis_read_setup(s);
+}
+
+template <class Source>
+err vorbis_init(Source& src, vorbis_state **out, const vorbis_options* options)
 {
     err e;
     vorbis_state *s = static_cast<vorbis_state*>(calloc(sizeof(vorbis_state), 1));
@@ -502,10 +779,11 @@ err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks)
         e = MALLOC;
         goto fail;
     }
-    s->callbacks = callbacks;
-    s->datasource = datasource;
+    if (options)
+        s->options = *options;
     s->next_sample = 0;
     s->file_pos = 0;
+    s->page_digest = PAGE_DIGEST_INIT;
     s->last_bs = 0;
     s->cur_packet.buf = static_cast<byte*>(malloc(MAX_PACKET_SIZE));
     if (!s->cur_packet.buf)
@@ -514,21 +792,18 @@ err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks)
         goto fail;
     }
     s->cur_packet.size = 0;
-    if ((e = vorbis_read_page(s)) != OK)
-        goto fail;
-
-    if ((e = vorbis_read_id(s)) != OK)
-        goto fail;
-
-    if ((e = vorbis_read_packet(s)) != OK)
-        goto fail;
-    if (vorbis_read_bits(&s->cur_packet, 8) != 3)
+    s->page_buf = static_cast<byte*>(malloc(MAX_PAGE_SIZE));
+    if (!s->page_buf)
     {
-        e = INVALID_DATA;
+        e = MALLOC;
         goto fail;
     }
-
-    if ((e = vorbis_read_setup(s)) != OK)
+    if ((e = vorbis_read_page(s, src)) != OK)
+        goto fail;
+    s->data_offset = s->cur_page_start;
+    s->chain_offset = s->data_offset;
+    s->resynced = false;
+    if ((e = vorbis_read_headers(s, src)) != OK)
         goto fail;
 
     *out = s;
@@ -540,22 +815,84 @@ fail:
     return e;
 }
 
-err vorbis_next(vorbis_state* vb)
+template <class Source>
+err vorbis_next(vorbis_state* vb, Source& src)
 {
     err e;
-    if ((e = vorbis_read_packet(vb)) != OK)
-        return e;
     vorbis_packet *p = &vb->cur_packet;
-
-    if (vorbis_read_bits(p, 1) != 0)
-        return INVALID_DATA;
-    uint32_t mode_number = vorbis_read_bits(p, ilog(vb->setup.mode_count - 1));
+    uint32_t mode_number;
+    for (;;)
+    {
+        if ((e = vorbis_read_packet(vb, src)) == CHAIN_BOUNDARY)
+        {
+            // Counting carries on from where the last stream really ended,
+            // or restarts for a separate map of the new one
+            int64_t base = vb->options.split_chains ? 0 : vb->chain_sample_base + vb->last_granule;
+            vb->chain_offset = vb->cur_page_start;
+            vb->chains++;
+            if ((e = vorbis_read_headers(vb, src)) != OK)
+                return e;
+            vb->chain_sample_base = base;
+            vb->next_sample = base;
+            vb->last_bs = 0;
+            vb->anchor_pending = false;
+            if (vb->options.split_chains)
+                return CHAIN_BOUNDARY;
+            continue;
+        }
+        if (e != OK)
+            return e;
+        if (vorbis_read_bits(p, 1) == 0)
+        {
+            mode_number = vorbis_read_bits(p, ilog(vb->setup.mode_count - 1));
+            if (mode_number < vb->setup.mode_count)
+                break;
+        }
+        if (!vb->options.resync)
+            return INVALID_DATA;
+        // A damaged packet breaks the chain of block overlaps, so sample
+        // counting restarts from the next granule position.
+        vb->last_bs = 0;
+        vb->anchor_pending = true;
+    }
     uint32_t blocksize = vb->setup.mode_configurations[mode_number].blockflag
         ? vb->id.blocksize_1 : vb->id.blocksize_0;
     blocksize = 1 << blocksize;
     if (vb->last_bs)
         vb->next_sample += (vb->last_bs + blocksize) / 4;
     vb->last_bs = blocksize;
-    
+    if (vb->anchor_pending && vb->cur_page.granule_pos != -1 && vorbis_packet_ends_page(vb))
+    {
+        vb->next_sample = vb->chain_sample_base + vb->cur_page.granule_pos;
+        vb->anchor_pending = false;
+    }
+
     return OK;
-}
\ No newline at end of file
+}
+
+err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks, const vorbis_options* options)
+{
+    CallbackSource src(datasource, callbacks);
+    err e = vorbis_init(src, out, options);
+    if (e == OK)
+    {
+        (*out)->callbacks = callbacks;
+        (*out)->datasource = datasource;
+    }
+    return e;
+}
+
+err vorbis_next(vorbis_state* vb)
+{
+    CallbackSource src(vb->datasource, vb->callbacks);
+    return vorbis_next(vb, src);
+}
+
+template err vorbis_init(MemorySource&, vorbis_state**, const vorbis_options*);
+template err vorbis_next(vorbis_state*, MemorySource&);
+template err vorbis_init(CallbackSource&, vorbis_state**, const vorbis_options*);
+template err vorbis_next(vorbis_state*, CallbackSource&);
+#if defined(MOGG_HAVE_FD_DATASOURCE)
+template err vorbis_init(FdSource&, vorbis_state**, const vorbis_options*);
+template err vorbis_next(vorbis_state*, FdSource&);
+#endif
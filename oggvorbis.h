@@ -33,11 +33,17 @@ enum err {
     INVALID_FLOOR,
     INVALID_RESIDUES,
     FRAMING_ERROR,
+    BAD_CHECKSUM,
+    CANCELLED,
+    FOREIGN_PAGE, // A page of another logical stream was stepped over
+    CHAIN_BOUNDARY, // A chained stream's headers were read, see split_chains
 };
 
 typedef uint8_t byte;
 
 constexpr size_t MAX_PACKET_SIZE = 0x8000; // Don't deal with packets over this size (32k)
+constexpr size_t PAGE_HEADER_SIZE = 27; // Fixed part of a page header, before the segment table
+constexpr size_t MAX_PAGE_SIZE = PAGE_HEADER_SIZE + 255 + 255 * 255;
 
 struct ogg_page_hdr {
     char capture_pattern[4];
@@ -50,6 +56,8 @@ struct ogg_page_hdr {
     byte page_segments;
     byte segment_table[256];
     long start_pos;
+    size_t header_size;
+    size_t body_size;
 };
 
 struct vorbis_packet {
@@ -117,9 +125,30 @@ struct vorbis_setup_header {
     vorbis_mode mode_configurations[64];
 };
 
+struct vorbis_options {
+    // When a page is missing its capture pattern, search forward for the
+    // next page with a valid CRC instead of failing. This also skips junk
+    // (such as an ID3 tag) in front of the first page.
+    bool resync;
+    // Check every page's CRC. A mismatch fails the scan, or is skipped
+    // like any other damage when resync is also set.
+    bool verify_crc;
+    // Called with the input offset of a page roughly every
+    // progress_interval bytes (every page if zero). Returning nonzero stops
+    // the scan with CANCELLED.
+    int (*progress)(void* user, uint64_t position);
+    void* progress_user;
+    uint64_t progress_interval;
+    // In a chained file, stop with CHAIN_BOUNDARY once the headers of each
+    // stream after the first have been read, with sample counting restarted
+    // from zero, instead of counting on across the whole file.
+    bool split_chains;
+};
+
 struct vorbis_state {
-    ov_callbacks callbacks;
+    ov_callbacks callbacks; // Input of the ov_callbacks API only
     void* datasource;
+    vorbis_options options;
     size_t file_pos;
     ogg_page_hdr cur_page;
     size_t cur_page_start;
@@ -130,10 +159,48 @@ struct vorbis_state {
     size_t cur_packet_start;
     vorbis_id_header id;
     vorbis_setup_header setup;
+    const byte* page; // Raw bytes of cur_page, header followed by body
+    byte* page_buf; // Holds the page when the source can't be read in place
+    size_t body_pos; // Offset in page of the next unread body byte
+    byte* scan_buf; // Lazily allocated window for resync
+    size_t data_offset; // Offset of the first Ogg page in the input
+    uint64_t skipped_bytes; // Bytes passed over by resync
+    uint32_t skipped_regions;
+    uint32_t crc_failures;
+    uint64_t page_digest; // Fingerprint of the pages read so far, see page_digest_add
+    bool resynced; // cur_page was found by resync, so a packet may be cut off
+    bool anchor_pending; // next_sample is unknown until a packet completes cur_page
+    uint64_t next_progress; // Page offset at which to call options.progress again
+    // The scan follows one Vorbis stream. Pages of other logical streams
+    // multiplexed with it (such as Skeleton) are skipped unread, and a new
+    // Vorbis stream chained after it is followed in turn.
+    int32_t serial;
+    bool serial_locked; // Until the identification header is found
+    bool stream_ended; // Its EOS page has been read, so a chain may follow
+    int64_t last_granule; // Of the stream's last page that had one
+    size_t chain_offset; // Input offset of the current chain's first page
+    int64_t chain_sample_base; // Sample the current chain's granules start from
+    uint32_t chains; // Chained streams begun after the first
 };
 
 // API
 const char* str_of_err(err e);
-err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks);
+// Folds one page into a cheap content fingerprint: FNV-1a over each page's
+// stored checksum and total length. Start from PAGE_DIGEST_INIT.
+constexpr uint64_t PAGE_DIGEST_INIT = 0xcbf29ce484222325ull;
+uint64_t page_digest_add(uint64_t digest, uint32_t checksum, uint32_t length);
+// Parses a page header and segment table from the `got` bytes at buf.
+err page_header_parse(const byte* buf, size_t got, ogg_page_hdr* hdr);
+err vorbis_init(void* datasource, vorbis_state **out, ov_callbacks callbacks, const vorbis_options* options = nullptr);
 void vorbis_free(vorbis_state* s);
-err vorbis_next(vorbis_state* s);
\ No newline at end of file
+// Parses an identification header packet on its own, without the rest of
+// a stream.
+err vorbis_parse_id(vorbis_packet* packet, vorbis_id_header* id);
+err vorbis_next(vorbis_state* s);
+// The same, scanning one of the sources in OggSource.h (MemorySource,
+// FdSource or CallbackSource) so its reads inline into the scanner. Pass
+// the same source to every call; an MmapSource scans as a MemorySource.
+template <class Source>
+err vorbis_init(Source& source, vorbis_state **out, const vorbis_options* options = nullptr);
+template <class Source>
+err vorbis_next(vorbis_state* s, Source& source);
\ No newline at end of file
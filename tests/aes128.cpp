@@ -0,0 +1,107 @@
+// Known answers for aes128_encrypt_blocks, through both the T-table code
+// and AES-NI where the CPU has it. Aes128.cpp checks single blocks at
+// compile time, but only through the T-tables; here runs of every length
+// from 1 to 9 blocks go through the AES-NI loop of four blocks and its
+// tail as well, out of place and in place.
+//
+// The vectors are FIPS-197's (appendices B and C.1), SP 800-38A's ECB
+// ones, and ctrKey0B blocks as the tiny-AES code the library used to
+// have encrypted them.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Aes128.h"
+#include "keys.h"
+
+struct Vector {
+    uint8_t in[16];
+    uint8_t out[16];
+};
+
+struct Key {
+    const char* name;
+    uint8_t key[16];
+    std::vector<Vector> vectors;
+};
+
+static const Key keys[] = {
+    { "FIPS-197 C.1",
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+      {
+          { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+            { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a } },
+      } },
+    { "FIPS-197 B and SP 800-38A",
+      { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+      {
+          { { 0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34 },
+            { 0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32 } },
+          { { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a },
+            { 0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97 } },
+          { { 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51 },
+            { 0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf } },
+          { { 0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef },
+            { 0x43, 0xb1, 0xcd, 0x7f, 0x59, 0x8e, 0xce, 0x23, 0x88, 0x1b, 0x00, 0xe3, 0xed, 0x03, 0x06, 0x88 } },
+          { { 0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 },
+            { 0x7b, 0x0c, 0x78, 0x5e, 0x27, 0xe8, 0xad, 0x3f, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5d, 0xd4 } },
+      } },
+    { "ctrKey0B",
+      { 0 },
+      {
+          { { 0 },
+            { 0xbf, 0xcc, 0x24, 0x45, 0x9b, 0x15, 0xd8, 0x0b, 0x97, 0xb1, 0x3f, 0xb2, 0x2b, 0x38, 0x8a, 0x2c } },
+          { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+            { 0x8a, 0xd0, 0xda, 0xfa, 0x78, 0x98, 0xc1, 0x99, 0xb9, 0x08, 0x56, 0xc5, 0x67, 0x53, 0x4b, 0x1b } },
+          { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+            { 0xc6, 0x9a, 0x2d, 0x4b, 0x25, 0xc3, 0xe9, 0x18, 0x12, 0xe8, 0xdb, 0x3a, 0x75, 0x10, 0xf2, 0xf1 } },
+      } },
+};
+
+// Encrypts runs of 1 to 9 blocks, cycling through the key's vectors, and
+// returns how many blocks came out wrong.
+static int Check(const char* impl, const Key& k) {
+    aes128_key key = aes128_expand_key(k.key);
+    int wrong = 0;
+    for (size_t blocks = 1; blocks <= 9; blocks++) {
+        std::vector<uint8_t> in(16 * blocks), out(16 * blocks), expected(16 * blocks);
+        for (size_t i = 0; i < blocks; i++) {
+            const Vector& v = k.vectors[i % k.vectors.size()];
+            memcpy(in.data() + 16 * i, v.in, 16);
+            memcpy(expected.data() + 16 * i, v.out, 16);
+        }
+        for (int in_place = 0; in_place < 2; in_place++) {
+            std::vector<uint8_t> buffer = in;
+            uint8_t* dst = in_place ? buffer.data() : out.data();
+            aes128_encrypt_blocks(key, buffer.data(), dst, blocks);
+            for (size_t i = 0; i < blocks; i++) {
+                if (memcmp(dst + 16 * i, expected.data() + 16 * i, 16) != 0) {
+                    fprintf(stderr, "%s, %s key: block %zu of %zu%s is wrong\n", impl, k.name, i, blocks,
+                            in_place ? " in place" : "");
+                    wrong++;
+                }
+            }
+        }
+    }
+    return wrong;
+}
+
+int main() {
+    std::vector<Key> all(std::begin(keys), std::end(keys));
+    memcpy(all.back().key, ctrKey0B, 16);
+
+    int wrong = 0, checked = 0;
+    for (bool hardware : { false, true }) {
+        if (aes128_use_hardware(hardware) != hardware) {
+            printf("aes128: no AES-NI on this CPU, T-tables only\n");
+            continue;
+        }
+        for (const Key& k : all)
+            wrong += Check(hardware ? "AES-NI" : "T-tables", k);
+        checked++;
+    }
+    aes128_use_hardware(true);
+    printf("aes128: %d implementations checked, %d blocks wrong\n", checked, wrong);
+    return wrong ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// Clips cut near the end of a stream, where only the primer and one more
+// packet may remain. A decoder trims the start of a first audio page only
+// if it isn't also the last, so such a clip is only right if it starts
+// where the primer ends; otherwise makemogg_extract_clip must refuse it.
+//
+// The stream comes from bench/synth_ogg.h, so its packet boundaries are
+// known without decoding: every packet fits on one page, and the mode bit
+// gives the block size.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "makemogg_lib.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+struct Page {
+    uint8_t flags;
+    int64_t granule;
+    std::vector<std::vector<uint8_t>> packets;
+};
+
+static std::vector<Page> ParsePages(const std::vector<uint8_t>& data, size_t at) {
+    std::vector<Page> pages;
+    while (at + 27 <= data.size() && memcmp(data.data() + at, "OggS", 4) == 0) {
+        Page page;
+        page.flags = data[at + 5];
+        memcpy(&page.granule, data.data() + at + 6, 8);
+        size_t segments = data[at + 26];
+        size_t body = at + 27 + segments;
+        std::vector<uint8_t> packet;
+        for (size_t i = 0; i < segments; i++) {
+            uint8_t length = data[at + 27 + i];
+            packet.insert(packet.end(), data.begin() + body, data.begin() + body + length);
+            body += length;
+            if (length < 255) {
+                page.packets.push_back(packet);
+                packet.clear();
+            }
+        }
+        pages.push_back(page);
+        at = body;
+    }
+    return pages;
+}
+
+static std::vector<uint8_t> ReadFile(const fs::path& path) {
+    std::vector<uint8_t> data(fs::file_size(path));
+    FILE* f = fopen(path.string().c_str(), "rb");
+    size_t got = f ? fread(data.data(), 1, data.size(), f) : 0;
+    if (f)
+        fclose(f);
+    data.resize(got);
+    return data;
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "makemogg_clip_end";
+    fs::create_directories(dir);
+    std::string input = (dir / "in.ogg").string(), output = (dir / "out.mogg").string();
+    auto ogg = synth::Generate(2, 7);
+    FILE* f = fopen(input.c_str(), "wb");
+    if (!f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size()) {
+        fprintf(stderr, "Could not write %s\n", input.c_str());
+        return 1;
+    }
+    fclose(f);
+
+    // Sample counts at the end of each packet, counted as the generator does
+    std::set<int64_t> boundaries;
+    int64_t samples = 0;
+    uint32_t last_bs = 0;
+    std::vector<Page> pages = ParsePages(ogg, 0);
+    for (size_t p = 2; p < pages.size(); p++) {
+        for (const auto& packet : pages[p].packets) {
+            uint32_t bs = (packet[0] & 2) ? 2048 : 256;
+            if (last_bs)
+                samples += (last_bs + bs) / 4;
+            last_bs = bs;
+            boundaries.insert(samples);
+        }
+    }
+    int64_t total = samples;
+    int64_t last_start = *std::prev(boundaries.end(), 2);
+
+    int failures = 0, cut = 0, refused = 0;
+    for (int64_t start = total - 3000; start < total; start++) {
+        for (int64_t end : { total, total + 10000 }) {
+            int rc = makemogg_extract_clip(input.c_str(), start, end, output.c_str(), nullptr, nullptr);
+            if (rc != 0) {
+                refused++;
+                if (start <= last_start && boundaries.count(start)) {
+                    fprintf(stderr, "clip %lld..%lld starts on a packet boundary but failed\n",
+                            static_cast<long long>(start), static_cast<long long>(end));
+                    failures++;
+                }
+                continue;
+            }
+            cut++;
+            std::vector<uint8_t> clip = ReadFile(output);
+            uint32_t header = 0;
+            memcpy(&header, clip.data() + 4, 4);
+            std::vector<Page> out = ParsePages(clip, header);
+            bool wrong = start > last_start || (out.size() > 2 && (out[2].flags & 4) && !boundaries.count(start));
+            if (wrong) {
+                fprintf(stderr, "clip %lld..%lld of %lld samples was cut but decodes wrongly\n",
+                        static_cast<long long>(start), static_cast<long long>(end),
+                        static_cast<long long>(total));
+                failures++;
+            }
+        }
+    }
+    fs::remove_all(dir);
+    printf("clip_end: %d cut, %d refused, %d wrong\n", cut, refused, failures);
+    return failures ? 1 : 0;
+}
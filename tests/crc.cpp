@@ -0,0 +1,139 @@
+// The Ogg page CRC through slicing-by-8 and, where the CPU has it, PCLMUL
+// folding, against a bitwise reference: lengths on both sides of every
+// block size the folding uses, at every alignment, continuing from a
+// nonzero CRC, and over whole pages with the stored checksum skipped.
+//
+// Then conversions with verify_crc of a stream with one damaged page body:
+// without resync the conversion must fail, and with it succeed, counting
+// the page in crc_failures. Without verify_crc the damage goes unnoticed.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "makemogg_lib.h"
+#include "oggcrc.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+static uint32_t ReferenceCrc(uint32_t crc, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+    }
+    return crc;
+}
+
+static int CheckCrc(const char* impl) {
+    std::mt19937 rng(27);
+    std::vector<uint8_t> buffer(4096 + 16);
+    for (auto& b : buffer)
+        b = static_cast<uint8_t>(rng());
+    int wrong = 0;
+    std::vector<size_t> lengths;
+    for (size_t len = 0; len <= 300; len++)
+        lengths.push_back(len);
+    for (size_t len : { 511, 512, 513, 1023, 1024, 1025, 4095, 4096 })
+        lengths.push_back(len);
+    for (size_t len : lengths) {
+        for (size_t align = 0; align < 16; align++) {
+            for (uint32_t start : { 0u, 0xdeadbeefu }) {
+                const uint8_t* data = buffer.data() + align;
+                uint32_t expected = ReferenceCrc(start, data, len);
+                uint32_t got = ogg_crc_update(start, data, len);
+                if (got != expected) {
+                    if (wrong++ < 5)
+                        fprintf(stderr, "%s: %zu bytes at +%zu from %08x gave %08x, not %08x\n", impl, len, align,
+                                start, got, expected);
+                }
+            }
+        }
+    }
+
+    // Every page of a stream, with its stored checksum in place
+    std::vector<uint8_t> ogg = synth::Generate(2, 27, 44100, 2, 20, 3000);
+    for (size_t at = 0; at + 27 <= ogg.size();) {
+        size_t length = 27 + ogg[at + 26];
+        for (size_t i = 0; i < ogg[at + 26]; i++)
+            length += ogg[at + 27 + i];
+        std::vector<uint8_t> page(ogg.begin() + at, ogg.begin() + at + length);
+        uint32_t stored;
+        memcpy(&stored, &page[22], 4);
+        memset(&page[22], 0, 4);
+        uint32_t expected = ReferenceCrc(0, page.data(), page.size());
+        if (stored != expected || ogg_page_crc(ogg.data() + at, length) != expected) {
+            if (wrong++ < 5)
+                fprintf(stderr, "%s: page at %zu checks wrong\n", impl, at);
+        }
+        at += length;
+    }
+    return wrong;
+}
+
+int main() {
+    int wrong = 0, checked = 0;
+    for (bool hardware : { false, true }) {
+        if (ogg_crc_use_hardware(hardware) != hardware) {
+            printf("crc: no PCLMUL on this CPU, slicing-by-8 only\n");
+            continue;
+        }
+        wrong += CheckCrc(hardware ? "PCLMUL" : "slicing-by-8");
+        checked++;
+    }
+    ogg_crc_use_hardware(true);
+
+    fs::path dir = fs::temp_directory_path() / "makemogg_crc";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::vector<uint8_t> ogg = synth::Generate(10, 28);
+    // Flip a byte in the body of an audio page in the middle
+    size_t at = 0, page = 0, middle = 0;
+    for (; at + 27 <= ogg.size(); page++) {
+        size_t length = 27 + ogg[at + 26];
+        for (size_t i = 0; i < ogg[at + 26]; i++)
+            length += ogg[at + 27 + i];
+        if (page == 40)
+            middle = at + length - 1;
+        at += length;
+    }
+    ogg[middle] ^= 0x10;
+    std::string input = (dir / "in.ogg").string(), output = (dir / "out.mogg").string();
+    FILE* f = fopen(input.c_str(), "wb");
+    if (!middle || !f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size()) {
+        fprintf(stderr, "Could not write %s\n", input.c_str());
+        return 1;
+    }
+    fclose(f);
+
+    int failures = 0;
+    for (int encrypt = 0; encrypt < 2; encrypt++) {
+        const char* kind = encrypt ? "encrypted" : "plain";
+        for (int verify = 0; verify < 2; verify++) {
+            for (int resync = 0; resync < 2; resync++) {
+                makemogg_options opts;
+                makemogg_options_init(&opts);
+                opts.verify_crc = verify;
+                opts.resync = resync;
+                makemogg_result result = {};
+                int rc = encrypt ? makemogg_create_encrypted(input.c_str(), output.c_str(), &opts, &result)
+                                 : makemogg_create_unencrypted_ex(input.c_str(), output.c_str(), &opts, &result);
+                bool fails = verify && !resync;
+                uint32_t crc_failures = verify && resync ? 1 : 0;
+                if ((rc != 0) != fails || (rc == 0 && result.crc_failures != crc_failures)) {
+                    fprintf(stderr, "%s, verify_crc %d, resync %d: gave %d with %u CRC failures\n", kind, verify,
+                            resync, rc, result.crc_failures);
+                    failures++;
+                }
+                fs::remove(output);
+            }
+        }
+    }
+    fs::remove_all(dir);
+    printf("crc: %d implementations checked, %d wrong; %d conversions wrong\n", checked, wrong, failures);
+    return wrong || failures ? 1 : 0;
+}
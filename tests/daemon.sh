@@ -0,0 +1,71 @@
+#!/bin/sh
+# Runs makemoggd on a temporary socket and drives it with makemoggc:
+# plain, encrypted and failing conversions, the stats reply, and a clean
+# shutdown on SIGTERM. Run from the top of the tree after building
+# makemogg, makemoggd and tests/make_ogg (make check does all of this).
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/makemoggd_test.XXXXXX") || exit 1
+sock="$dir/d.sock"
+pid=
+fail() {
+    echo "daemon: $*" >&2
+    [ -n "$pid" ] && kill "$pid" 2>/dev/null
+    rm -rf "$dir"
+    exit 1
+}
+
+./tests/make_ogg "$dir/in.ogg" 20 3 || fail "could not make an input"
+./makemogg "$dir/in.ogg" "$dir/ref.mogg" >/dev/null || fail "could not make the reference mogg"
+
+./daemon/makemoggd -s "$sock" -j 2 2>/dev/null &
+pid=$!
+tries=0
+while [ ! -S "$sock" ]; do
+    tries=$((tries + 1))
+    [ $tries -gt 50 ] && fail "makemoggd didn't create its socket"
+    kill -0 "$pid" 2>/dev/null || fail "makemoggd exited at startup"
+    sleep 0.1
+done
+
+# Plain, with hashes: the same bytes as the library makes directly
+./daemon/makemoggc -s "$sock" -H "$dir/in.ogg" "$dir/plain.mogg" > "$dir/plain.txt" \
+    || fail "plain conversion failed"
+cmp -s "$dir/plain.mogg" "$dir/ref.mogg" || fail "plain output differs from makemogg's"
+reported=$(awk '$1 == "sha256" { print $2 }' "$dir/plain.txt")
+if command -v sha256sum >/dev/null; then
+    actual=$(sha256sum "$dir/plain.mogg" | cut -d' ' -f1)
+elif command -v shasum >/dev/null; then
+    actual=$(shasum -a 256 "$dir/plain.mogg" | cut -d' ' -f1)
+else
+    actual=$reported
+fi
+[ -n "$reported" ] && [ "$reported" = "$actual" ] || fail "reported SHA-256 $reported, file has $actual"
+
+# Encrypted: an 0xB mogg, the plain one plus a 16-byte IV
+./daemon/makemoggc -s "$sock" -e "$dir/in.ogg" "$dir/enc.mogg" >/dev/null || fail "encrypted conversion failed"
+version=$(od -An -tx1 -N4 "$dir/enc.mogg" | tr -d ' \n')
+[ "$version" = "0b000000" ] || fail "encrypted output has version $version"
+plain_size=$(wc -c < "$dir/plain.mogg")
+enc_size=$(wc -c < "$dir/enc.mogg")
+[ $((plain_size + 16)) -eq "$enc_size" ] || fail "encrypted output is $enc_size bytes, expected $((plain_size + 16))"
+
+# A missing input fails with its own error, and the client says so
+./daemon/makemoggc -s "$sock" "$dir/missing.ogg" "$dir/missing.mogg" > "$dir/missing.txt"
+[ $? -eq 1 ] || fail "a missing input didn't fail"
+grep -q "error 1" "$dir/missing.txt" || fail "a missing input didn't report error 1"
+
+./daemon/makemoggc -s "$sock" --stats > "$dir/stats.txt" || fail "no stats reply"
+stat_of() { awk -v name="$1" '$1 == name { print $2 }' "$dir/stats.txt"; }
+[ "$(stat_of workers)" = 2 ] || fail "stats report $(stat_of workers) workers"
+[ "$(stat_of completed)" = 3 ] || fail "stats report $(stat_of completed) completed jobs"
+[ "$(stat_of failed)" = 1 ] || fail "stats report $(stat_of failed) failed jobs"
+
+kill -TERM "$pid"
+wait "$pid"
+status=$?
+pid=
+[ $status -eq 0 ] || fail "makemoggd exited with $status on SIGTERM"
+[ ! -e "$sock" ] || fail "makemoggd left its socket behind"
+
+rm -rf "$dir"
+echo "daemon: ok"
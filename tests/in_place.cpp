@@ -0,0 +1,163 @@
+// The functions that rewrite a mogg in place. makemogg_encrypt_in_place
+// must leave the same 0xB file that makemogg_create_encrypted makes from
+// the same 0xA mogg, when the IV doesn't depend on chance: seeded, or taken
+// from the input's pages. Moves of one block and of many small ones are
+// both checked.
+//
+// makemogg_remap to a different chunk_size and back must give the original
+// file again, byte for byte. Remapping a mogg whose payload starts with
+// junk, with resync, must drop the junk and, for 0xB, re-encrypt the rest
+// at its new positions: the result is the mogg made from the clean stream.
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "makemogg_lib.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> ReadFile(const fs::path& path) {
+    std::error_code ec;
+    std::vector<uint8_t> data(fs::file_size(path, ec));
+    FILE* f = fopen(path.string().c_str(), "rb");
+    size_t got = f ? fread(data.data(), 1, data.size(), f) : 0;
+    if (f)
+        fclose(f);
+    data.resize(got);
+    return data;
+}
+
+static bool WriteFile(const fs::path& path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.string().c_str(), "wb");
+    bool ok = f && fwrite(data.data(), 1, data.size(), f) == data.size();
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "makemogg_in_place";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    std::vector<uint8_t> chain = synth::Generate(3, 4), link = synth::Generate(2, 5);
+    chain.insert(chain.end(), link.begin(), link.end());
+    const std::pair<const char*, std::vector<uint8_t>> inputs[] = {
+        { "short", synth::Generate(0.5, 1) },
+        { "long", synth::Generate(30, 2) },
+        { "chain", chain },
+    };
+    static const char seed[] = "in place";
+
+    int failures = 0, compared = 0;
+    for (const auto& input : inputs) {
+        fs::path ogg = dir / (std::string(input.first) + ".ogg");
+        fs::path mogg = dir / (std::string(input.first) + ".mogg");
+        if (!WriteFile(ogg, input.second)
+            || makemogg_create_unencrypted(ogg.string().c_str(), mogg.string().c_str()) != 0) {
+            fprintf(stderr, "Could not make %s\n", mogg.string().c_str());
+            return 1;
+        }
+        for (int iv_mode : { MAKEMOGG_IV_SEED, MAKEMOGG_IV_INPUT_HASH }) {
+            for (size_t block : { size_t(0), size_t(4096) }) {
+                makemogg_options opts;
+                makemogg_options_init(&opts);
+                opts.iv_mode = iv_mode;
+                opts.iv_seed = seed;
+                opts.iv_seed_length = sizeof(seed);
+                opts.write_chunk_size = block;
+
+                fs::path copied = dir / "copied.mogg", in_place = dir / "in_place.mogg";
+                fs::remove(in_place);
+                fs::copy_file(mogg, in_place);
+                int created = makemogg_create_encrypted(mogg.string().c_str(), copied.string().c_str(), &opts, nullptr);
+                int moved = makemogg_encrypt_in_place(in_place.string().c_str(), &opts, nullptr);
+                compared++;
+                const char* how = iv_mode == MAKEMOGG_IV_SEED ? "seeded" : "input-hash";
+                if (created != 0 || moved != 0) {
+                    fprintf(stderr, "%s, %s IV, block %zu: create gave %d, in place %d\n", input.first, how,
+                            block, created, moved);
+                    failures++;
+                } else if (ReadFile(in_place) != ReadFile(copied)) {
+                    fprintf(stderr, "%s, %s IV, block %zu: encrypted in place differs from created\n",
+                            input.first, how, block);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    for (const auto& input : inputs) {
+        fs::path ogg = dir / (std::string(input.first) + ".ogg");
+        for (int encrypt = 0; encrypt < 2; encrypt++) {
+            makemogg_options opts;
+            makemogg_options_init(&opts);
+            opts.iv_mode = MAKEMOGG_IV_SEED;
+            opts.iv_seed = seed;
+            opts.iv_seed_length = sizeof(seed);
+            const char* kind = encrypt ? "0xB" : "0xA";
+            fs::path original = dir / "original.mogg", remapped = dir / "remapped.mogg";
+            fs::remove(original);
+            fs::remove(remapped);
+            std::string in = ogg.string(), out = original.string();
+            int rc = encrypt ? makemogg_create_encrypted(in.c_str(), out.c_str(), &opts, nullptr)
+                             : makemogg_create_unencrypted_ex(in.c_str(), out.c_str(), &opts, nullptr);
+            if (rc != 0) {
+                fprintf(stderr, "%s: could not make the %s mogg (%d)\n", input.first, kind, rc);
+                failures++;
+                continue;
+            }
+            std::vector<uint8_t> before = ReadFile(original);
+
+            // To a finer map and back
+            fs::copy_file(original, remapped);
+            makemogg_options finer = opts;
+            finer.chunk_size = 5000;
+            int there = makemogg_remap(remapped.string().c_str(), &finer, nullptr);
+            bool changed = ReadFile(remapped) != before;
+            int back = makemogg_remap(remapped.string().c_str(), &opts, nullptr);
+            compared++;
+            if (there != 0 || back != 0 || !changed) {
+                fprintf(stderr, "%s, %s: remap there gave %d%s, back %d\n", input.first, kind, there,
+                        changed ? "" : " but changed nothing", back);
+                failures++;
+            } else if (ReadFile(remapped) != before) {
+                fprintf(stderr, "%s, %s: remapped there and back differs from the original\n", input.first, kind);
+                failures++;
+            }
+
+            // Junk between the header and the first page. The 0xB is made
+            // from the junk-laden 0xA, so the junk is encrypted with it.
+            std::vector<uint8_t> a;
+            if (makemogg_create_unencrypted(ogg.string().c_str(), remapped.string().c_str()) == 0)
+                a = ReadFile(remapped);
+            uint32_t offset = a.size() >= 8 ? a[4] | a[5] << 8 | a[6] << 16 | uint32_t(a[7]) << 24 : 0;
+            std::vector<uint8_t> junk(5000);
+            for (size_t i = 0; i < junk.size(); i++)
+                junk[i] = static_cast<uint8_t>(i * 7);
+            a.insert(a.begin() + offset, junk.begin(), junk.end());
+            fs::remove(remapped);
+            bool made = offset && WriteFile(remapped, a)
+                && (!encrypt || makemogg_encrypt_in_place(remapped.string().c_str(), &opts, nullptr) == 0);
+            makemogg_options resync = opts;
+            resync.resync = 1;
+            makemogg_result result = {};
+            rc = made ? makemogg_remap(remapped.string().c_str(), &resync, &result) : -1;
+            compared++;
+            if (rc != 0 || result.skipped_bytes != junk.size()) {
+                fprintf(stderr, "%s, %s with junk: remap gave %d, skipping %llu bytes\n", input.first, kind, rc,
+                        static_cast<unsigned long long>(result.skipped_bytes));
+                failures++;
+            } else if (ReadFile(remapped) != before) {
+                fprintf(stderr, "%s, %s with junk: remapped differs from the clean mogg\n", input.first, kind);
+                failures++;
+            }
+        }
+    }
+    fs::remove_all(dir);
+    printf("in_place: %d compared, %d wrong\n", compared, failures);
+    return failures ? 1 : 0;
+}
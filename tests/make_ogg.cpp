@@ -0,0 +1,24 @@
+// Writes a synthetic Ogg Vorbis file, for the scripted tests.
+//
+//   tests/make_ogg <output> [seconds] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "../bench/synth_ogg.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: make_ogg <output> [seconds] [seed]\n");
+        return 2;
+    }
+    double seconds = argc > 2 ? atof(argv[2]) : 10;
+    uint32_t seed = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 1;
+    auto ogg = synth::Generate(seconds, seed);
+    FILE* f = fopen(argv[1], "wb");
+    if (!f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size() || fclose(f) != 0) {
+        fprintf(stderr, "make_ogg: could not write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
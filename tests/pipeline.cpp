@@ -0,0 +1,128 @@
+// Encrypted conversion with the read, encrypt and write stages overlapped
+// on threads must give the same bytes, result and hashes as with them run
+// one after another, from an ogg and from an 0xA mogg, with the default
+// write size and a small one that gives many chunks. A progress callback
+// that cancels while mapping or while writing must make either mode
+// return 6 and remove the partly written output.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "makemogg_lib.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> ReadFile(const fs::path& path) {
+    std::error_code ec;
+    std::vector<uint8_t> data(fs::file_size(path, ec));
+    FILE* f = fopen(path.string().c_str(), "rb");
+    size_t got = f ? fread(data.data(), 1, data.size(), f) : 0;
+    if (f)
+        fclose(f);
+    data.resize(got);
+    return data;
+}
+
+// Cancels once `stage` has reached `at` bytes.
+struct Canceller {
+    int stage;
+    uint64_t at;
+    bool asked;
+};
+
+static int CancelAt(void* user, int stage, uint64_t position, uint64_t) {
+    auto* c = static_cast<Canceller*>(user);
+    if (stage != c->stage || position < c->at)
+        return 0;
+    c->asked = true;
+    return 1;
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "makemogg_pipeline";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string ogg = (dir / "in.ogg").string(), mogg = (dir / "in.mogg").string();
+    std::string output = (dir / "out.mogg").string();
+    std::vector<uint8_t> data = synth::Generate(120, 36);
+    FILE* f = fopen(ogg.c_str(), "wb");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+        fprintf(stderr, "Could not write %s\n", ogg.c_str());
+        return 1;
+    }
+    fclose(f);
+    if (makemogg_create_unencrypted(ogg.c_str(), mogg.c_str()) != 0) {
+        fprintf(stderr, "Could not make %s\n", mogg.c_str());
+        return 1;
+    }
+    static const char seed[] = "pipeline";
+
+    int failures = 0, compared = 0;
+    for (const std::string& input : { ogg, mogg }) {
+        const char* from = input == ogg ? "ogg" : "0xA";
+        for (size_t chunk : { size_t(0), size_t(8192) }) {
+            std::vector<uint8_t> outputs[2];
+            makemogg_result results[2];
+            for (int pipeline = 0; pipeline < 2; pipeline++) {
+                makemogg_options opts;
+                makemogg_options_init(&opts);
+                opts.pipeline = pipeline;
+                opts.write_chunk_size = chunk;
+                opts.hash = MAKEMOGG_HASH_XXH64 | MAKEMOGG_HASH_SHA256;
+                opts.iv_mode = MAKEMOGG_IV_SEED;
+                opts.iv_seed = seed;
+                opts.iv_seed_length = sizeof(seed);
+                results[pipeline] = makemogg_result{};
+                if (makemogg_create_encrypted(input.c_str(), output.c_str(), &opts, &results[pipeline]) != 0) {
+                    fprintf(stderr, "From %s, chunk %zu, pipeline %d: conversion failed\n", from, chunk, pipeline);
+                    failures++;
+                }
+                outputs[pipeline] = ReadFile(output);
+            }
+            compared++;
+            if (outputs[0].empty() || outputs[0] != outputs[1]) {
+                fprintf(stderr, "From %s, chunk %zu: pipelined output differs\n", from, chunk);
+                failures++;
+            } else if (results[0].hashes != results[1].hashes || results[0].xxh64 != results[1].xxh64
+                       || memcmp(results[0].sha256, results[1].sha256, 32) != 0
+                       || results[0].skipped_bytes != results[1].skipped_bytes
+                       || results[0].crc_failures != results[1].crc_failures) {
+                fprintf(stderr, "From %s, chunk %zu: pipelined result or hashes differ\n", from, chunk);
+                failures++;
+            }
+        }
+    }
+
+    for (int stage : { MAKEMOGG_STAGE_MAP, MAKEMOGG_STAGE_WRITE }) {
+        for (int pipeline = 0; pipeline < 2; pipeline++) {
+            Canceller canceller{ stage, data.size() / 2, false };
+            makemogg_options opts;
+            makemogg_options_init(&opts);
+            opts.pipeline = pipeline;
+            opts.write_chunk_size = 65536;
+            opts.progress = CancelAt;
+            opts.progress_user = &canceller;
+            opts.progress_interval = 65536;
+            int rc = makemogg_create_encrypted(ogg.c_str(), output.c_str(), &opts, nullptr);
+            const char* when = stage == MAKEMOGG_STAGE_MAP ? "mapping" : "writing";
+            compared++;
+            if (!canceller.asked || rc != 6) {
+                fprintf(stderr, "Cancelled while %s, pipeline %d: gave %d%s\n", when, pipeline, rc,
+                        canceller.asked ? "" : " without asking");
+                failures++;
+            }
+            if (fs::exists(output)) {
+                fprintf(stderr, "Cancelled while %s, pipeline %d: left its output behind\n", when, pipeline);
+                failures++;
+                fs::remove(output);
+            }
+        }
+    }
+    fs::remove_all(dir);
+    printf("pipeline: %d compared, %d wrong\n", compared, failures);
+    return failures ? 1 : 0;
+}
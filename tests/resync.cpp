@@ -0,0 +1,180 @@
+// Conversions with resync, of a stream behind leading junk (such as an ID3
+// tag), of one with a page whose capture pattern is damaged, and of one
+// with both. Without resync junk fails the conversion and damage ends the
+// map. With it the junk is dropped, so the mogg is the one made from the
+// clean stream, while a damaged page stays in the Ogg data but the map
+// goes on past it and no seek point leads into it; skipped_bytes and
+// skipped_regions must count exactly what was passed over.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "makemogg_lib.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> ReadFile(const fs::path& path) {
+    std::error_code ec;
+    std::vector<uint8_t> data(fs::file_size(path, ec));
+    FILE* f = fopen(path.string().c_str(), "rb");
+    size_t got = f ? fread(data.data(), 1, data.size(), f) : 0;
+    if (f)
+        fclose(f);
+    data.resize(got);
+    return data;
+}
+
+static bool WriteFile(const fs::path& path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.string().c_str(), "wb");
+    bool ok = f && fwrite(data.data(), 1, data.size(), f) == data.size();
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+// Start offsets of the pages of a well-formed stream.
+static std::vector<size_t> PageStarts(const std::vector<uint8_t>& data) {
+    std::vector<size_t> starts;
+    for (size_t at = 0; at + 27 <= data.size();) {
+        starts.push_back(at);
+        size_t segments = data[at + 26];
+        size_t body = 0;
+        for (size_t i = 0; i < segments; i++)
+            body += data[at + 27 + i];
+        at += 27 + segments + body;
+    }
+    return starts;
+}
+
+struct Case {
+    const char* name;
+    size_t junk;
+    bool damage;
+};
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "makemogg_resync";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    std::vector<uint8_t> clean = synth::Generate(10, 11);
+    std::vector<size_t> pages = PageStarts(clean);
+    // An audio page in the middle, well past the headers
+    size_t damaged = pages[pages.size() / 2];
+    size_t damaged_length = pages[pages.size() / 2 + 1] - damaged;
+    std::vector<uint8_t> junk(3000);
+    for (size_t i = 0; i < junk.size(); i++)
+        junk[i] = static_cast<uint8_t>(i * 13 + 1);
+
+    const Case cases[] = {
+        { "leading junk", junk.size(), false },
+        { "damaged page", 0, true },
+        { "both", junk.size(), true },
+    };
+    static const char seed[] = "resync";
+    fs::path clean_ogg = dir / "clean.ogg", input = dir / "in.ogg";
+    fs::path expected = dir / "expected.mogg", output = dir / "out.mogg";
+    if (!WriteFile(clean_ogg, clean)) {
+        fprintf(stderr, "Could not write %s\n", clean_ogg.string().c_str());
+        return 1;
+    }
+
+    int failures = 0, checked = 0;
+    for (const Case& c : cases) {
+        std::vector<uint8_t> ogg = clean;
+        if (c.damage)
+            ogg[damaged + 3] = 'X';
+        ogg.insert(ogg.begin(), junk.begin(), junk.begin() + c.junk);
+        if (!WriteFile(input, ogg)) {
+            fprintf(stderr, "Could not write %s\n", input.string().c_str());
+            return 1;
+        }
+        for (int encrypt = 0; encrypt < 2; encrypt++) {
+            makemogg_options opts;
+            makemogg_options_init(&opts);
+            opts.iv_mode = MAKEMOGG_IV_SEED;
+            opts.iv_seed = seed;
+            opts.iv_seed_length = sizeof(seed);
+            const char* kind = encrypt ? "encrypted" : "plain";
+            auto convert = [&](const fs::path& from, const fs::path& to, makemogg_result* result) {
+                std::string in = from.string(), out = to.string();
+                return encrypt ? makemogg_create_encrypted(in.c_str(), out.c_str(), &opts, result)
+                               : makemogg_create_unencrypted_ex(in.c_str(), out.c_str(), &opts, result);
+            };
+            checked++;
+
+            // Where the map sends a seek to near the end of the stream
+            auto last_point = [&](const std::vector<uint8_t>& mogg) -> int64_t {
+                makemogg_map* map = makemogg_map_view(mogg.data(), mogg.size());
+                makemogg_seek_point point = {};
+                bool found = map && makemogg_map_lookup(map, 9 * 44100, &point) == 0;
+                makemogg_map_free(map);
+                return found ? point.ogg_offset : -1;
+            };
+            int rc = convert(input, output, nullptr);
+            if (c.junk ? rc == 0 : (rc != 0 || last_point(ReadFile(output)) >= static_cast<int64_t>(damaged))) {
+                fprintf(stderr, "%s, %s: without resync gave %d%s\n", c.name, kind, rc,
+                        rc == 0 ? " and mapped past the damage" : "");
+                failures++;
+            }
+
+            opts.resync = 1;
+            opts.exact_seek_points = 1;
+            makemogg_result result = {};
+            rc = convert(input, output, &result);
+            uint64_t skipped = c.junk + (c.damage ? damaged_length : 0);
+            uint32_t regions = (c.junk ? 1 : 0) + (c.damage ? 1 : 0);
+            if (rc != 0 || result.skipped_bytes != skipped || result.skipped_regions != regions) {
+                fprintf(stderr, "%s, %s: resync gave %d, skipping %llu bytes in %u places, not %llu in %u\n",
+                        c.name, kind, rc, static_cast<unsigned long long>(result.skipped_bytes),
+                        result.skipped_regions, static_cast<unsigned long long>(skipped), regions);
+                failures++;
+                continue;
+            }
+            std::vector<uint8_t> mogg = ReadFile(output);
+            if (!c.damage) {
+                if (convert(clean_ogg, expected, nullptr) != 0 || mogg != ReadFile(expected)) {
+                    fprintf(stderr, "%s, %s: differs from the mogg of the clean stream\n", c.name, kind);
+                    failures++;
+                }
+                continue;
+            }
+
+            uint32_t header = 0;
+            memcpy(&header, mogg.data() + 4, 4);
+            if (!encrypt && !std::equal(mogg.begin() + header, mogg.end(), ogg.begin() + c.junk, ogg.end())) {
+                fprintf(stderr, "%s, %s: the Ogg data isn't the input's\n", c.name, kind);
+                failures++;
+            }
+            if (last_point(mogg) < static_cast<int64_t>(damaged + damaged_length)) {
+                fprintf(stderr, "%s, %s: the map ends at the damage\n", c.name, kind);
+                failures++;
+            }
+            // Every seek point is a page start, as exact_seek_points asks
+            makemogg_map* map = makemogg_map_view(mogg.data(), mogg.size());
+            for (uint64_t sample = 0; map && sample < 10 * 44100; sample += 997) {
+                makemogg_seek_point point;
+                if (makemogg_map_lookup(map, sample, &point) != 0)
+                    break;
+                bool inside = point.ogg_offset >= damaged && point.ogg_offset < damaged + damaged_length;
+                bool page = encrypt || memcmp(mogg.data() + point.file_offset, "OggS", 4) == 0;
+                if (inside || !page) {
+                    fprintf(stderr, "%s, %s: sample %llu seeks to %u, %s\n", c.name, kind,
+                            static_cast<unsigned long long>(sample), point.ogg_offset,
+                            inside ? "in the damaged page" : "not a page");
+                    failures++;
+                    break;
+                }
+            }
+            makemogg_map_free(map);
+        }
+    }
+    fs::remove_all(dir);
+    printf("resync: %d conversions checked, %d wrong\n", checked, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+// Threads that convert one file after another for as long as the process
+// runs, as makemoggd's workers and the library's executor do, must not
+// hold on to anything from a finished conversion beyond the buffers they
+// cache on purpose. The input is a chain of many short links, since each
+// link has its own setup header to parse.
+//
+// The heap in use is compared after a warm-up and after many more
+// conversions; that needs glibc's mallinfo2, so elsewhere the conversions
+// only run.
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "MoggWriter.h"
+#include "makemogg_lib.h"
+#include "../bench/synth_ogg.h"
+
+namespace fs = std::filesystem;
+
+static size_t HeapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "makemogg_worker_memory";
+    fs::create_directories(dir);
+    std::string input = (dir / "chain.ogg").string();
+    std::vector<uint8_t> ogg;
+    for (uint32_t link = 0; link < 40; link++) {
+        auto part = synth::Generate(0.2, 100 + link);
+        ogg.insert(ogg.end(), part.begin(), part.end());
+    }
+    FILE* f = fopen(input.c_str(), "wb");
+    if (!f || fwrite(ogg.data(), 1, ogg.size(), f) != ogg.size()) {
+        fprintf(stderr, "Could not write %s\n", input.c_str());
+        return 1;
+    }
+    fclose(f);
+
+    const int jobs = 8;
+    std::vector<std::string> outputs;
+    for (int i = 0; i <= jobs; i++)
+        outputs.push_back((dir / ("out" + std::to_string(i) + ".mogg")).string());
+
+    int failures = 0;
+    // A daemon worker, keeping its chunk buffers, alongside a round of
+    // jobs on the executor
+    auto round = [&] {
+        bool worker_failed = false;
+        std::thread worker([&] {
+            MoggWriter::CacheChunks(true);
+            makemogg_options opts;
+            makemogg_options_init(&opts);
+            if (makemogg_create_unencrypted_ex(input.c_str(), outputs[jobs].c_str(), &opts, nullptr) != 0
+                || makemogg_create_encrypted(input.c_str(), outputs[jobs].c_str(), &opts, nullptr) != 0)
+                worker_failed = true;
+            MoggWriter::CacheChunks(false);
+        });
+        makemogg_job job[jobs] = {};
+        makemogg_task* tasks[jobs];
+        for (int i = 0; i < jobs; i++) {
+            job[i].input_path = input.c_str();
+            job[i].output_path = outputs[i].c_str();
+            job[i].encrypt = i & 1;
+            tasks[i] = makemogg_submit(&job[i], nullptr, nullptr, nullptr);
+        }
+        for (int i = 0; i < jobs; i++) {
+            if (!tasks[i] || makemogg_task_wait(tasks[i]) != 0)
+                failures++;
+            makemogg_task_free(tasks[i]);
+        }
+        worker.join();
+        if (worker_failed)
+            failures++;
+    };
+
+    for (int i = 0; i < 10; i++)
+        round();
+    size_t before = HeapInUse();
+    for (int i = 0; i < 100; i++)
+        round();
+    size_t after = HeapInUse();
+    fs::remove_all(dir);
+
+    long long grown = static_cast<long long>(after) - static_cast<long long>(before);
+    if (grown > 256 * 1024) {
+        fprintf(stderr, "heap grew by %lld bytes over 100 rounds of conversions\n", grown);
+        failures++;
+    }
+    printf("worker_memory: %lld bytes grown, %d failed\n", grown, failures);
+    return failures ? 1 : 0;
+}